@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Calibration of the whole roster
+ *
+ * A single group message asks every node to calibrate, and the nodes spread
+ * their answers over a window sized from the roster. The nodes that haven't
+ * answered by the end of the window are then asked one at a time, for a few
+ * rounds. The answers are collected by roster position, and a single record
+ * is printed to the host at the end:
+ *
+ * calibration <roster crc> <seconds> <nodes> <calibrated> <missing>
+ *             <threshold min> <threshold max> <noise max> <noisiest node>
+ *
+ * The roster CRC and the missing bitmap are as in the sweep summary. The
+ * thresholds and the noise are LDR resistances, and are 0 if no node
+ * answered.
+ */
+
+#ifndef CALIBRATION_H__
+#define CALIBRATION_H__
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include "light_monitor_cli.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the calibration.
+ *
+ * @param[in] monitor Light Monitor instance used to reach the servers.
+ * @param[in] sh Shell used to report to the host.
+ */
+void calibration_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh);
+
+/** @brief Calibrate every node of the roster.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -EBUSY A calibration is already running.
+ * @retval -ENOENT The roster is empty.
+ */
+int calibration_start(void);
+
+/** @brief Calibrate a single node, outside of the roster calibration.
+ *
+ * @param[in] addr Unicast address of the node.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int calibration_node(uint16_t addr);
+
+/** @brief Pass a received calibration answer.
+ *
+ * @param[in] addr Address of the node that answered.
+ * @param[in] status The answer.
+ *
+ * @return true if the answer belongs to the running roster calibration, and
+ *         is reported with it.
+ */
+bool calibration_received(uint16_t addr, const struct light_monitor_calibrate_status *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALIBRATION_H__ */
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Zoned test campaign scheduler
+ *
+ * A campaign runs the light test in waves. The roster is partitioned into
+ * zones, each with its own group address, and only a limited number of nodes
+ * are tested at the same time. The next zone is started as soon as the
+ * results of a running zone have landed, so result traffic is spread over
+ * time and part of the building always keeps its lighting.
+ */
+
+#ifndef CAMPAIGN_H__
+#define CAMPAIGN_H__
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include "light_monitor_cli.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Zone index of roster nodes that are not assigned to any zone. */
+#define CAMPAIGN_NO_ZONE 0xFF
+
+/** @brief Initialize the campaign scheduler.
+ *
+ * @param[in] monitor Light Monitor instance used to reach the servers.
+ * @param[in] sh Shell used to report progress to the host.
+ */
+void campaign_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh);
+
+/** @brief Remove all zones and zone assignments. */
+void campaign_zones_reset(void);
+
+/** @brief Define a zone.
+ *
+ * @param[in] zone Zone index.
+ * @param[in] group_addr Group address the servers of the zone subscribe to.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int campaign_zone_set(uint8_t zone, uint16_t group_addr);
+
+/** @brief Assign a roster node to a zone.
+ *
+ * @param[in] zone Zone index.
+ * @param[in] addr Unicast address of a node in the roster.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -ENOENT The zone has no group address, see campaign_zone_set().
+ */
+int campaign_zone_node_add(uint8_t zone, uint16_t addr);
+
+/** @brief Forget the zone of a roster entry, when it is given to another node.
+ *
+ * @param[in] idx Index of the entry in the roster.
+ */
+void campaign_node_clear(int idx);
+
+/** @brief Start a campaign.
+ *
+ * @param[in] duration Test duration in seconds.
+ * @param[in] max_concurrent Maximum number of nodes under test at once.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -ENOENT A roster node isn't assigned to any zone with a group address.
+ */
+int campaign_start(uint16_t duration, uint16_t max_concurrent);
+
+/** @brief Check whether a campaign is running. */
+bool campaign_is_active(void);
+
+/** @brief Notify the scheduler that a node acknowledged its test start. */
+void campaign_ack_received(uint16_t addr);
+
+/** @brief Notify the scheduler that a node reported its test result. */
+void campaign_result_received(uint16_t addr);
+
+/** @brief Get the zone a roster node is assigned to.
+ *
+ * @param[in] addr Unicast address of a node in the roster.
+ *
+ * @return Zone index, or CAMPAIGN_NO_ZONE.
+ */
+uint8_t campaign_node_zone(uint16_t addr);
+
+/** @brief Get the group address of a zone.
+ *
+ * @param[in] zone Zone index.
+ *
+ * @return Group address, or BT_MESH_ADDR_UNASSIGNED if the zone isn't defined.
+ */
+uint16_t campaign_zone_group(uint8_t zone);
+
+/** @brief Answer a node asking for the start parameters of its wave.
+ *
+ * @param[in] ctx Context of the incoming get start message.
+ *
+ * @return true if the node belongs to a running wave and was answered.
+ */
+bool campaign_get_start(struct bt_mesh_msg_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAMPAIGN_H__ */
@@ -17,30 +17,19 @@
 #include <zephyr/bluetooth/mesh.h>
 #include <bluetooth/mesh/model_types.h>
 #include <bluetooth/mesh/sensor_cli.h>
+#include "light_monitor_msg.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID 0x0059
 #define BT_MESH_LIGHT_MONITOR_VENDOR_MODEL_ID 0x000C
 
 #define BT_MESH_LIGHT_MONITOR_VENDOR_SETUP_MODEL_ID 0x000D
 
-#define GET_STATUS_OPCODE BT_MESH_MODEL_OP_3(0x01, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_ACK_OPCODE BT_MESH_MODEL_OP_3(0x02, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_RESULT_OPCODE BT_MESH_MODEL_OP_3(0x03, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define UPDATE_STATUS_OPCODE BT_MESH_MODEL_OP_3(0x04, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_START_OPCODE BT_MESH_MODEL_OP_3(0x05, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define RESULT_LOG_OPCODE BT_MESH_MODEL_OP_3(0x06, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_LOG_OPCODE BT_MESH_MODEL_OP_3(0x07, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_ACK_OPCODE BT_MESH_MODEL_OP_3(0x08, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_START_OPCODE BT_MESH_MODEL_OP_3(0x09, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_RESULT_OPCODE BT_MESH_MODEL_OP_3(0x0A, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_TEST_START_OPCODE BT_MESH_MODEL_OP_3(0x0B, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-
-#define CALIBRATE_OPCODE BT_MESH_MODEL_OP_3(0x0C, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define CALIBRATE_OK_OPCODE BT_MESH_MODEL_OP_3(0x0D, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
+/* Vendor models of the light monitor servers, see light_monitor_srv.h */
+#define BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID 0x000B
+#define BT_MESH_LIGHT_MONITOR_SRV_SETUP_MODEL_ID 0x000C
 
 #define BT_MESH_LIGHT_MONITOR_MSG_MINLEN_MESSAGE 1
 #define BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE                                                   \
@@ -49,17 +38,6 @@ extern "C" {
 #define BT_MESH_LIGHT_MONITOR_MSG_LEN_PRESENCE 1
 #define BT_MESH_LIGHT_MONITOR_MSG_LEN_PRESENCE_GET 0
 
-#define GET_STATUS_LEN 0
-#define TEST_ACK_LEN 0
-#define TEST_RESULT_LEN 1
-#define STATUS_UPDATE_LEN 2
-#define TEST_START_LEN 1
-#define RESULT_LOG_LEN 5
-#define GET_LOG_LEN 1
-#define GET_START_LEN 0
-#define GET_RESULT_LEN 0
-#define CALIBRATE_LEN 0
-
 #define SLEEP_TIME_MS 1000
 #define RECEIVE_BUFF_SIZE 2000
 #define RECEIVE_TIMEOUT 100
@@ -98,20 +76,30 @@ struct bt_light_monitor_handlers {
      *
      * @param[in] monitor Light Monitor instance that received the result.
      * @param[in] ctx Context of the incoming message.
-     * @param[in] result Pointer to the received result.
+     * @param[in] result Received result, with the supply voltages seen during the test.
      */
 	void (*const result)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-			     bool *result);
+			     const struct light_monitor_test_result *result);
+
+	/** @brief Handler for a test progress message.
+     *
+     * @param[in] monitor Light Monitor instance that received the progress.
+     * @param[in] ctx Context of the incoming message.
+     * @param[in] progress Progress of the test running on the server.
+     */
+	void (*const progress)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+			       const struct light_monitor_test_progress *progress);
 
 	/** @brief Handler for a result log entry.
      *
      * @param[in] monitor Light Monitor instance that received the result log.
      * @param[in] ctx Context of the incoming message.
      * @param[in] result The result of given test.
-     * @param[in] time_stamp The timestamp of when the test was started.
+     * @param[in] reported Whether the gateway acknowledged the result when it was sent.
+     * @param[in] age Minutes since the test was started.
      */
 	int (*const result_log)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-				 bool result, uint32_t time_stamp);
+				 bool result, bool reported, uint32_t age);
 
 	/** @brief Handler for a test acknowledgement message.
      *
@@ -132,8 +120,28 @@ struct bt_light_monitor_handlers {
      *
      * @param[in] monitor Light Monitor instance that received the get start message.
      * @param[in] ctx Context of the incoming message.
+     * @param[in] status Calibration round answered, new threshold and sensor noise.
+     */
+	void (*const calibrate_ok)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+				   const struct light_monitor_calibrate_status *status);
+
+	/** @brief Handler for a schedule status message.
+     *
+     * @param[in] monitor Light Monitor instance that received the schedule status.
+     * @param[in] ctx Context of the incoming message.
+     * @param[in] schedule The test schedule the server is running.
      */
-	void (*const calibrate_ok)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx);
+	void (*const schedule_status)(struct bt_mesh_light_monitor *monitor,
+				      struct bt_mesh_msg_ctx *ctx,
+				      const struct test_schedule *schedule);
+
+	/** @brief Called when a request that the server answers was sent to a
+	 * single server.
+	 *
+	 * @param[in] monitor Light Monitor instance that sent the request.
+	 * @param[in] addr Unicast address of the server.
+	 */
+	void (*const request_sent)(struct bt_mesh_light_monitor *monitor, uint16_t addr);
 };
 
 struct bt_mesh_light_monitor {
@@ -146,8 +154,8 @@ struct bt_mesh_light_monitor {
 
 	struct bt_mesh_sensor_cli sensor_cli;
 	/** Publication message buffer. */
-	uint16_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
-					   BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
+	uint8_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
+					  BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
 	/** Handler function structure. */
 	const struct bt_light_monitor_handlers *handlers;
 };
@@ -160,21 +168,27 @@ struct bt_mesh_light_monitor_setup {
 	/** Publication message. */
 	struct net_buf_simple pub_msg;
 	/** Publication message buffer. */
-	uint16_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
-					   BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
+	uint8_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
+					  BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
 	/** Handler function structure. */
 	const struct bt_light_monitor_setup_handlers *handlers;
 };
 
-int set_light_test_start(struct bt_mesh_light_monitor *monitor, uint16_t test_duration,
-			 uint32_t time_stamp);
+int set_light_test_start(struct bt_mesh_light_monitor *monitor, uint16_t test_duration);
 int get_status(struct bt_mesh_light_monitor *monitor);
+int get_status_single(struct bt_mesh_light_monitor *monitor, uint16_t addr);
 int get_test_result(struct bt_mesh_light_monitor *monitor, uint16_t addr);
 int set_light_test_start_single(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-				uint16_t test_duration, uint32_t timestamp);
+				uint16_t test_duration);
 int get_test_ack(struct bt_mesh_light_monitor *monitor, uint16_t addr);
 int get_result_log(struct bt_mesh_light_monitor *monitor, uint16_t addr);
-int calibrate_node(struct bt_mesh_light_monitor *monitor, uint16_t addr);
+int calibrate_node(struct bt_mesh_light_monitor *monitor, uint16_t addr,
+		   const struct light_monitor_calibrate *msg);
+int calibrate_all(struct bt_mesh_light_monitor *monitor, const struct light_monitor_calibrate *msg);
+int send_result_ack(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+		    uint16_t seq);
+int set_test_schedule(struct bt_mesh_light_monitor *monitor, uint16_t addr,
+		      const struct test_schedule *schedule);
 
 /** @cond INTERNAL_HIDDEN */
 extern const struct bt_mesh_model_op _bt_mesh_light_monitor_op[];
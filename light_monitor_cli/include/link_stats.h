@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Link quality of every roster node, as seen from the gateway
+ *
+ * Every message received from a node updates a rolling average of its RSSI
+ * and its hop count, derived from the received TTL. The RSSI is the one of
+ * the last hop, so for nodes behind relays it tells how well the gateway
+ * hears the relay. Every unicast request the gateway sends to a node counts
+ * against its reply rate, and a request sent again before the node answered
+ * counts as a retry. Both are kept over a window of the last requests.
+ *
+ * The table is printed to the host every
+ * @kconfig{CONFIG_BT_MESH_LIGHT_MONITOR_LINK_STATS_PERIOD} seconds, a line
+ * per 32 roster positions:
+ *
+ * links <roster crc> <nodes> <first index> <entries>
+ *
+ * Every entry is 4 bytes in hex: the RSSI in dBm (signed, -128 if the node
+ * was never heard), the hop count (0 if unknown), the reply rate in percent
+ * (255 if the node was never asked) and the retries in the window.
+ */
+
+#ifndef LINK_STATS_H__
+#define LINK_STATS_H__
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINK_STATS_RSSI_UNKNOWN INT8_MIN
+#define LINK_STATS_HOPS_UNKNOWN 0
+
+/** @brief Initialize the link statistics, and start the periodic export.
+ *
+ * @param[in] sh Shell used to report to the host.
+ */
+void link_stats_init(const struct shell *sh);
+
+/** @brief Forget a roster entry, when it is given to another node.
+ *
+ * @param[in] idx Index of the entry in the roster.
+ */
+void link_stats_clear(int idx);
+
+/** @brief Record a message received from a node.
+ *
+ * @param[in] ctx Context of the received message.
+ */
+void link_stats_rx(const struct bt_mesh_msg_ctx *ctx);
+
+/** @brief Record a unicast request that the node is expected to answer.
+ *
+ * @param[in] addr Unicast address of the node.
+ */
+void link_stats_request(uint16_t addr);
+
+/** @brief Record the hop count of a node measured with a heartbeat.
+ *
+ * @param[in] idx Index of the node in the roster.
+ * @param[in] hops Hop count, or @ref LINK_STATS_HOPS_UNKNOWN.
+ */
+void link_stats_hops_set(int idx, uint8_t hops);
+
+/** @brief Get the average RSSI of a node.
+ *
+ * @param[in] idx Index of the node in the roster.
+ *
+ * @return RSSI in dBm, or @ref LINK_STATS_RSSI_UNKNOWN.
+ */
+int8_t link_stats_rssi(int idx);
+
+/** @brief Get the TTL of the last message received from a node.
+ *
+ * @param[in] idx Index of the node in the roster.
+ *
+ * @return Received TTL, 0 if the node was never heard.
+ */
+uint8_t link_stats_ttl(int idx);
+
+/** @brief Print the table of the whole roster to the host.
+ *
+ * The table is printed from the log work queue, like the periodic export.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -ENOENT The roster is empty.
+ */
+int link_stats_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LINK_STATS_H__ */
@@ -13,6 +13,8 @@
 #define MODEL_HANDLER_H__
 
 #include <zephyr/bluetooth/mesh.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,8 +25,11 @@ extern "C" {
 #define TEST_DURATION_TESTING 60
 #define TEST_TIME_STAMP 1111111111
 
+#define ROSTER_SIZE CONFIG_BT_MESH_LIGHT_MONITOR_ROSTER_SIZE
+
 struct NodesList {
-	uint16_t nodes[512];
+	uint16_t nodes[ROSTER_SIZE];
+	/** Number of nodes in use. */
 	uint16_t len;
 };
 
@@ -34,6 +39,43 @@ struct UartInput {
 	uint16_t duration;
 };
 
+/** Roster of the nodes under test, filled in by the host. */
+extern struct NodesList active_nodes;
+
+/** @brief Clear a bitmap with a bit per roster entry.
+ *
+ * @param[out] bitmap Bitmap defined with ATOMIC_DEFINE(name, ROSTER_SIZE).
+ */
+void roster_bitmap_clear(atomic_t *bitmap);
+
+/** @brief Get the IEEE CRC32 of the roster addresses, little endian.
+ *
+ * Reported with the records indexed by roster position, so the host can check
+ * that it maps them to the same roster.
+ */
+uint32_t roster_crc(void);
+
+/** @brief Find a node in the roster.
+ *
+ * @param[in] addr Unicast address of the node.
+ *
+ * @return Index of the node in active_nodes, or -ENOENT.
+ */
+int active_nodes_find(uint16_t addr);
+
+/** @brief Get the work queue of the Configuration Client requests.
+ *
+ * The requests block until the node answers and the client handles one at a
+ * time, so they are all made from this queue.
+ */
+struct k_work_q *cfg_cli_workq(void);
+
+/** @brief Get the network time of the gateway.
+ *
+ * @return Unix time, or 0 if the gateway has not been given the time yet.
+ */
+uint32_t current_time_stamp(void);
+
 const struct bt_mesh_comp *model_handler_init(void);
 
 #ifdef __cplusplus
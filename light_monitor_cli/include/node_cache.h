@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Cache of the last known state of every roster node
+ *
+ * The gateway keeps the last status, result and log entry of every node,
+ * and when it last heard from it, filled from all the traffic it receives.
+ * Status queries from the host are answered from the cache. Only the nodes
+ * whose status is older than the requested maximum age are asked again,
+ * one at a time, or all at once with a single group message when most of
+ * them are stale.
+ */
+
+#ifndef NODE_CACHE_H__
+#define NODE_CACHE_H__
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include "light_monitor_cli.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the cache.
+ *
+ * @param[in] monitor Light Monitor instance used to refresh stale entries.
+ * @param[in] sh Shell used to answer the host.
+ */
+void node_cache_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh);
+
+/** @brief Forget a roster entry, when it is given to another node.
+ *
+ * @param[in] idx Index of the entry in the roster.
+ */
+void node_cache_clear(int idx);
+
+/** @brief Record that a message was received from a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ */
+void node_cache_seen(uint16_t addr);
+
+/** @brief Record the status of a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ * @param[in] value Light sensor reading of the node.
+ */
+void node_cache_status(uint16_t addr, uint16_t value);
+
+/** @brief Record the last test result of a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ * @param[in] passed Whether the test passed.
+ */
+void node_cache_result(uint16_t addr, bool passed);
+
+/** @brief Record a log entry of a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ * @param[in] time_stamp Unix time of the logged test.
+ */
+void node_cache_log(uint16_t addr, uint32_t time_stamp);
+
+/** @brief Print the status of every roster node, and refresh stale ones.
+ *
+ * Fresh entries are printed right away, the stale ones when they answer.
+ *
+ * @param[in] max_age_s Oldest status that is still printed from the cache,
+ *		      in seconds.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int node_cache_query(uint32_t max_age_s);
+
+/** @brief Print everything the cache holds about a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int node_cache_print(uint16_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NODE_CACHE_H__ */
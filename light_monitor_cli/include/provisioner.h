@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Commissioning of the nodes by the gateway
+ *
+ * With @kconfig{CONFIG_BT_MESH_LIGHT_MONITOR_PROVISIONER}, the gateway creates
+ * the network and provisions the nodes itself. While a scan is open, every
+ * unprovisioned light monitor server that beacons is queued and provisioned
+ * over PB-ADV, one link at a time. Each provisioned node is then configured
+ * from the Configuration Client, on its own thread, while the next one is
+ * being provisioned: the application key is added and bound, the light
+ * monitor models publish to the gateway group and subscribe to the node
+ * group. Progress is reported to the host as it happens:
+ *
+ * provisioning <uuid>
+ * provisioned <addr> <uuid>
+ * provision failed <uuid>
+ * configured <addr>
+ * configure failed <addr> <err>
+ * commission done <provisioned> <configured> <failed>
+ *
+ * When a roster node is assigned to a campaign zone, or configured while it is
+ * in one, the light monitor server of the node is subscribed to the group of
+ * the zone, in place of the group of its previous zone:
+ *
+ * zone subscribed <addr> <group>
+ * zone subscribe failed <addr> <err>
+ *
+ * A campaign started before a node is subscribed doesn't reach it with the
+ * start of its wave, and the node is polled into the wave instead.
+ *
+ * The nodes are provisioned without authentication by default, see
+ * @kconfig{CONFIG_BT_MESH_LIGHT_MONITOR_PROV_AUTH_STATIC}.
+ *
+ * Without it, the network is set up with a phone and every function returns
+ * -ENOTSUP.
+ */
+
+#ifndef PROVISIONER_H__
+#define PROVISIONER_H__
+
+#include <errno.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROVISIONER
+
+/** @brief Get the provisioning parameters of the gateway.
+ *
+ * @return Provisioning parameters to initialize the mesh stack with.
+ */
+const struct bt_mesh_prov *provisioner_prov_init(void);
+
+/** @brief Initialize the provisioner.
+ *
+ * @param[in] sh Shell used to report progress to the host.
+ */
+void provisioner_init(const struct shell *sh);
+
+/** @brief Create a new network with the gateway as its first node.
+ *
+ * The gateway is provisioned with new keys and configured like the nodes.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -EALREADY The gateway is already part of a network.
+ */
+int provisioner_create(void);
+
+/** @brief Commission the unprovisioned nodes heard during the given time.
+ *
+ * @param[in] seconds How long to accept new nodes.
+ *
+ * The nodes that failed their configuration before are tried again.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -ENOENT There is no network to add the nodes to.
+ * @retval -EBUSY The previous commissioning hasn't finished.
+ * @retval -EINVAL The static OOB value isn't valid hex.
+ */
+int provisioner_scan(uint16_t seconds);
+
+/** @brief Subscribe the roster nodes whose zone changed to the zone's group. */
+void provisioner_zones_sync(void);
+
+/** @brief Forget the zone subscription of a roster entry given to another node.
+ *
+ * @param[in] idx Index of the entry in the roster.
+ */
+void provisioner_zone_clear(int idx);
+
+#else
+
+static inline int provisioner_create(void)
+{
+	return -ENOTSUP;
+}
+
+static inline int provisioner_scan(uint16_t seconds)
+{
+	return -ENOTSUP;
+}
+
+static inline void provisioner_zones_sync(void)
+{
+}
+
+static inline void provisioner_zone_clear(int idx)
+{
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROVISIONER_H__ */
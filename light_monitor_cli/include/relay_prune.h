@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Relay pruning based on the topology seen from the gateway
+ *
+ * The gateway surveys the hop count of every roster node with heartbeats, and
+ * takes the RSSI of the messages it receives from them from the link
+ * statistics. In each zone it keeps the relay feature enabled on the few
+ * nodes one hop away with the strongest link, and disables it on the nodes
+ * of the last hop layer through its Configuration Client. The RSSI of nodes
+ * further away is the one of their last relay, so their layers aren't ranked
+ * and keep relaying. If a node can't be reached after the change, all nodes
+ * are restored.
+ *
+ * The same survey sizes the network transmit, relay retransmit and light
+ * monitor publish retransmit of every node from the roster size and its hop
+ * count. The settings are pushed to the whole roster without reading them or
+ * waiting for the answers. Every node is then read back once, the settings it
+ * didn't take are set again, and the result is reported to the host:
+ *
+ * transmit <addr> <net retransmits> <relay retransmits> <publish retransmits>
+ * transmit failed <addr> <err>
+ * transmit done <nodes> <tuned> <failed>
+ *
+ * The Configuration Client needs the device keys of the nodes, so the gateway
+ * has to be the provisioner of the network.
+ */
+
+#ifndef RELAY_PRUNE_H__
+#define RELAY_PRUNE_H__
+
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize relay pruning.
+ *
+ * @param[in] elem Gateway element that receives the heartbeats.
+ * @param[in] sh Shell used to report progress to the host.
+ */
+void relay_prune_init(const struct bt_mesh_elem *elem, const struct shell *sh);
+
+/** @brief Survey the hop count of every roster node.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int relay_prune_survey(void);
+
+/** @brief Survey the network, then disable the relays that aren't needed.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int relay_prune_start(void);
+
+/** @brief Restore the relay state of every node changed by the last pruning.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int relay_prune_restore(void);
+
+/** @brief Survey the network, then tune the retransmissions of every node.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int relay_prune_tune(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RELAY_PRUNE_H__ */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Store-and-forward ring of the results received by the gateway
+ *
+ * Every test result and log entry the gateway receives is appended to a
+ * flash circular buffer with a sequence number, and "stored <seq>" is
+ * printed once it is in flash. The host keeps the last sequence number it
+ * has processed, and on reconnect asks for everything after it. The entries
+ * are printed again as logged results, so a host that was down during a
+ * campaign doesn't lose its results. When the ring is full the oldest flash
+ * page is erased.
+ *
+ * While a sweep runs, its results are only printed in the sweep record, so
+ * the acknowledgements are held and a single one is printed after the record.
+ */
+
+#ifndef RESULT_RING_H__
+#define RESULT_RING_H__
+
+#include <zephyr/shell/shell.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the ring, and find its last sequence number.
+ *
+ * @param[in] sh Shell used to report the stored entries to the host.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int result_ring_init(const struct shell *sh);
+
+/** @brief Queue an entry to be appended to the ring.
+ *
+ * The flash is written from the log work queue.
+ *
+ * @param[in] addr Unicast address of the node.
+ * @param[in] result Whether the test passed.
+ * @param[in] time_stamp Unix time of the test.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int result_ring_append(uint16_t addr, bool result, uint32_t time_stamp);
+
+/** @brief Hold the acknowledgements of the stored entries. */
+void result_ring_hold(void);
+
+/** @brief Print a single acknowledgement of every entry stored while held. */
+void result_ring_release(void);
+
+/** @brief Print every entry stored after a sequence number.
+ *
+ * @param[in] seq Last sequence number the host has processed.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ */
+int result_ring_replay(uint32_t seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RESULT_RING_H__ */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Compact summary of a test sweep
+ *
+ * While a sweep runs, the results of the roster nodes are collected in
+ * bitmaps indexed by roster position instead of being printed one by one,
+ * and their stored lines are held. The supply and switchover lines of every
+ * node are still printed as the results come in, as the record can't carry
+ * them.
+ * At the end of the sweep a single record is printed to the host:
+ *
+ * sweep <roster crc> <start> <end> <nodes> <pass> <fail> <missing>
+ *
+ * The roster CRC is the IEEE CRC32 of the roster addresses, little endian,
+ * so the host can check that it maps the bitmaps to the same roster. The
+ * timestamps are Unix time, and every result of the sweep is filed under the
+ * start, both here and in the result ring. The bitmaps are hex encoded, bit 0
+ * of the first byte being the first roster node.
+ */
+
+#ifndef SWEEP_SUMMARY_H__
+#define SWEEP_SUMMARY_H__
+
+#include <zephyr/shell/shell.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Initialize the sweep summary.
+ *
+ * @param[in] sh Shell used to report the summary to the host.
+ */
+void sweep_summary_init(const struct shell *sh);
+
+/** @brief Start collecting the results of a sweep over the roster. */
+void sweep_summary_start(void);
+
+/** @brief Check whether the results are collected for a summary. */
+bool sweep_summary_active(void);
+
+/** @brief Get the timestamp the results of the sweep are stamped with.
+ *
+ * @return Unix time the sweep started at, 0 if the gateway had no time.
+ */
+uint32_t sweep_summary_time_stamp(void);
+
+/** @brief Record the result of a node.
+ *
+ * @param[in] addr Unicast address of the node.
+ * @param[in] passed Whether the test passed.
+ */
+void sweep_summary_result(uint16_t addr, bool passed);
+
+/** @brief End the sweep and print its summary record. */
+void sweep_summary_finish(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SWEEP_SUMMARY_H__ */
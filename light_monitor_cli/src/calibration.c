@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#include "light_monitor_cli.h"
+#include "light_monitor_workq.h"
+#include "model_handler.h"
+#include "calibration.h"
+
+/* The nodes that didn't answer are asked one per tick to pace the traffic */
+#define CALIBRATION_TICK_MS 250
+/* Time given to the nodes to sample and answer after the window or a round */
+#define CALIBRATION_SETTLE_MS 3000
+#define CALIBRATION_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
+
+#define ROSTER_BYTES DIV_ROUND_UP(ROSTER_SIZE, 8)
+
+static struct {
+	struct bt_mesh_light_monitor *monitor;
+	const struct shell *shell;
+	int64_t started_at;
+	uint16_t seq;
+	uint16_t nodes;
+	uint16_t calibrated;
+	uint16_t threshold_min;
+	uint16_t threshold_max;
+	uint16_t noise_max;
+	uint16_t noisiest;
+	/* Targeted round, and the roster position it has reached */
+	uint8_t round;
+	uint16_t next_idx;
+	bool active;
+} calib;
+
+/* Nodes that haven't answered the running calibration, by roster index */
+static ATOMIC_DEFINE(pending, ROSTER_SIZE);
+static uint8_t missing[ROSTER_BYTES];
+static char hex[ROSTER_BYTES * 2 + 1];
+
+static struct k_work_delayable calibration_work;
+
+/* Answers are spread over a window long enough for the whole roster to
+ * answer at the configured rate.
+ */
+static uint16_t calibration_window(uint16_t nodes)
+{
+	uint32_t window_ms = (uint32_t)nodes * MSEC_PER_SEC /
+			     CONFIG_BT_MESH_LIGHT_MONITOR_CALIBRATION_REPLY_RATE;
+
+	return MIN(DIV_ROUND_UP(window_ms, CALIBRATE_WINDOW_UNIT_MS), UINT16_MAX);
+}
+
+static void calibration_finish(void)
+{
+	int len = active_nodes.len;
+
+	calib.active = false;
+
+	memset(missing, 0, sizeof(missing));
+	for (int i = 0; i < len; i++) {
+		WRITE_BIT(missing[i / 8], i % 8, atomic_test_bit(pending, i));
+	}
+
+	if (!bin2hex(missing, DIV_ROUND_UP(len, 8), hex, sizeof(hex))) {
+		hex[0] = '\0';
+	}
+
+	shell_print(calib.shell, "calibration %08x %u %u %u %s %u %u %u %u", roster_crc(),
+		    (uint32_t)((k_uptime_get() - calib.started_at) / MSEC_PER_SEC), calib.nodes,
+		    calib.calibrated, len ? hex : "-", calib.threshold_min, calib.threshold_max,
+		    calib.noise_max, calib.noisiest);
+}
+
+/* Ask the next node of the round that hasn't answered. Once a round is done,
+ * the answers are given time to land before the next round starts.
+ */
+static void calibration_tick(struct k_work *work)
+{
+	struct light_monitor_calibrate msg = {
+		.seq = calib.seq,
+		.window = 0,
+	};
+
+	if (calib.calibrated >= calib.nodes ||
+	    calib.round > CONFIG_BT_MESH_LIGHT_MONITOR_CALIBRATION_RETRIES) {
+		calibration_finish();
+		return;
+	}
+
+	for (int i = calib.next_idx; i < active_nodes.len; i++) {
+		if (!atomic_test_bit(pending, i)) {
+			continue;
+		}
+
+		calib.next_idx = i + 1;
+		(void)calibrate_node(calib.monitor, active_nodes.nodes[i], &msg);
+		k_work_reschedule_for_queue(CALIBRATION_WQ, &calibration_work,
+					    K_MSEC(CALIBRATION_TICK_MS));
+		return;
+	}
+
+	calib.round++;
+	calib.next_idx = 0;
+	k_work_reschedule_for_queue(CALIBRATION_WQ, &calibration_work,
+				    K_MSEC(CALIBRATION_SETTLE_MS));
+}
+
+int calibration_start(void)
+{
+	struct light_monitor_calibrate msg;
+	int err;
+
+	if (calib.active) {
+		return -EBUSY;
+	}
+
+	roster_bitmap_clear(pending);
+	calib.nodes = 0;
+	for (int i = 0; i < active_nodes.len; i++) {
+		if (active_nodes.nodes[i] != 0) {
+			atomic_set_bit(pending, i);
+			calib.nodes++;
+		}
+	}
+
+	if (calib.nodes == 0) {
+		return -ENOENT;
+	}
+
+	msg.seq = ++calib.seq;
+	msg.window = calibration_window(calib.nodes);
+
+	calib.started_at = k_uptime_get();
+	calib.calibrated = 0;
+	calib.threshold_min = 0;
+	calib.threshold_max = 0;
+	calib.noise_max = 0;
+	calib.noisiest = BT_MESH_ADDR_UNASSIGNED;
+	calib.round = 1;
+	calib.next_idx = 0;
+	calib.active = true;
+
+	err = calibrate_all(calib.monitor, &msg);
+	if (err) {
+		calib.active = false;
+		return err;
+	}
+
+	k_work_reschedule_for_queue(CALIBRATION_WQ, &calibration_work,
+				    K_MSEC((uint32_t)msg.window * CALIBRATE_WINDOW_UNIT_MS +
+					   CALIBRATION_SETTLE_MS));
+	return 0;
+}
+
+int calibration_node(uint16_t addr)
+{
+	struct light_monitor_calibrate msg = {
+		.window = 0,
+	};
+
+	/* A new round would make the running calibration ignore its answers */
+	if (calib.active) {
+		return -EBUSY;
+	}
+
+	msg.seq = ++calib.seq;
+	return calibrate_node(calib.monitor, addr, &msg);
+}
+
+bool calibration_received(uint16_t addr, const struct light_monitor_calibrate_status *status)
+{
+	int idx = active_nodes_find(addr);
+
+	if (!calib.active || status->seq != calib.seq || idx < 0) {
+		return false;
+	}
+
+	/* A repeated answer is only counted once */
+	if (!atomic_test_and_clear_bit(pending, idx)) {
+		return true;
+	}
+
+	if (calib.calibrated++ == 0) {
+		calib.threshold_min = status->threshold;
+		calib.threshold_max = status->threshold;
+	}
+
+	calib.threshold_min = MIN(calib.threshold_min, status->threshold);
+	calib.threshold_max = MAX(calib.threshold_max, status->threshold);
+	if (calib.noisiest == BT_MESH_ADDR_UNASSIGNED || status->noise > calib.noise_max) {
+		calib.noise_max = status->noise;
+		calib.noisiest = addr;
+	}
+
+	/* Report as soon as the whole roster has answered */
+	if (calib.calibrated >= calib.nodes) {
+		k_work_reschedule_for_queue(CALIBRATION_WQ, &calibration_work, K_NO_WAIT);
+	}
+
+	return true;
+}
+
+void calibration_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh)
+{
+	calib.monitor = monitor;
+	calib.shell = sh;
+	/* A node remembers the last round it answered, so the rounds of the
+	 * gateway must not restart from the same number after a reboot.
+	 */
+	calib.seq = sys_rand32_get();
+	k_work_init_delayable(&calibration_work, calibration_tick);
+}
@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include "light_monitor_cli.h"
+#include "model_handler.h"
+#include "campaign.h"
+#include "provisioner.h"
+#include "sweep_summary.h"
+#include "light_monitor_workq.h"
+
+/* The scheduler sends at most one targeted poll per tick to pace the traffic */
+#define CAMPAIGN_TICK_MS 500
+/* Time given to a wave to acknowledge the start before the nodes are polled */
+#define CAMPAIGN_ACK_WINDOW_S 2
+/* Waves are timed from the sample work queue, which nothing else holds up.
+ * Their lines to the host are printed from the log work queue.
+ */
+#define CAMPAIGN_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_SAMPLE)
+#define REPORT_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG)
+/* Every zone starts and finishes once per campaign */
+#define REPORT_QUEUE_LEN (2 * CONFIG_BT_MESH_LIGHT_MONITOR_MAX_ZONES)
+
+#define NODE_ACKED BIT(0)
+#define NODE_REPORTED BIT(1)
+#define NODE_POLLED BIT(2)
+
+enum wave_state {
+	WAVE_IDLE,
+	WAVE_RUNNING,
+	WAVE_POLLING,
+	WAVE_DONE,
+};
+
+struct campaign_zone {
+	uint16_t group_addr;
+	uint16_t node_count;
+	uint16_t reported;
+	int64_t started_at;
+	enum wave_state state;
+};
+
+static struct {
+	struct bt_mesh_light_monitor *monitor;
+	const struct shell *shell;
+	struct campaign_zone zones[CONFIG_BT_MESH_LIGHT_MONITOR_MAX_ZONES];
+	uint8_t node_zone[ARRAY_SIZE(active_nodes.nodes)];
+	uint8_t node_flags[ARRAY_SIZE(active_nodes.nodes)];
+	uint16_t running_nodes;
+	uint16_t max_concurrent;
+	uint16_t duration;
+	bool active;
+} campaign;
+
+struct wave_report {
+	uint8_t zone_idx;
+	bool done;
+	uint16_t reported;
+	uint16_t node_count;
+};
+
+static struct k_work_delayable campaign_work;
+
+K_MSGQ_DEFINE(report_queue, sizeof(struct wave_report), REPORT_QUEUE_LEN, 2);
+
+static void report_work_handler(struct k_work *work)
+{
+	struct wave_report report;
+
+	while (!k_msgq_get(&report_queue, &report, K_NO_WAIT)) {
+		if (report.done) {
+			shell_print(campaign.shell, "wave %d done %d %d", report.zone_idx,
+				    report.reported, report.node_count);
+		} else {
+			shell_print(campaign.shell, "wave %d started %d", report.zone_idx,
+				    report.node_count);
+		}
+	}
+}
+
+/* Queued behind the wave reports. The campaign stays active until its sweep
+ * record is printed, so a new campaign can't reset the sweep before that.
+ */
+static void done_work_handler(struct k_work *work)
+{
+	shell_print(campaign.shell, "campaign done");
+	sweep_summary_finish();
+	campaign.active = false;
+}
+
+static K_WORK_DEFINE(report_work, report_work_handler);
+static K_WORK_DEFINE(done_work, done_work_handler);
+
+static void wave_report(uint8_t zone_idx, bool done)
+{
+	const struct campaign_zone *zone = &campaign.zones[zone_idx];
+	struct wave_report report = {
+		.zone_idx = zone_idx,
+		.done = done,
+		.reported = zone->reported,
+		.node_count = zone->node_count,
+	};
+
+	(void)k_msgq_put(&report_queue, &report, K_NO_WAIT);
+	k_work_submit_to_queue(REPORT_WQ, &report_work);
+}
+
+static uint8_t zone_count(void)
+{
+	uint8_t count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		if (campaign.zones[i].group_addr != BT_MESH_ADDR_UNASSIGNED) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* Zones with nodes to test, once the campaign has counted them */
+static uint8_t active_zones(void)
+{
+	uint8_t count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		if (campaign.zones[i].group_addr != BT_MESH_ADDR_UNASSIGNED &&
+		    campaign.zones[i].node_count != 0) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static uint8_t running_zones(void)
+{
+	uint8_t count = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		if (campaign.zones[i].state == WAVE_RUNNING ||
+		    campaign.zones[i].state == WAVE_POLLING) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static void wave_start(uint8_t zone_idx)
+{
+	struct campaign_zone *zone = &campaign.zones[zone_idx];
+	struct bt_mesh_msg_ctx ctx = {
+		.addr = zone->group_addr,
+		.app_idx = campaign.monitor->model->keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+
+	zone->started_at = k_uptime_get();
+	zone->state = WAVE_RUNNING;
+	zone->reported = 0;
+	campaign.running_nodes += zone->node_count;
+
+	set_light_test_start_single(campaign.monitor, &ctx, campaign.duration);
+	wave_report(zone_idx, false);
+}
+
+static void wave_finish(uint8_t zone_idx)
+{
+	struct campaign_zone *zone = &campaign.zones[zone_idx];
+
+	zone->state = WAVE_DONE;
+	campaign.running_nodes -= zone->node_count;
+	wave_report(zone_idx, true);
+}
+
+/* Start idle zones in order for as long as the concurrency cap allows it. A
+ * zone is always started when nothing is running, so an oversized zone can't
+ * stall the campaign, but all zones with nodes are never started together.
+ */
+static void waves_fill(void)
+{
+	uint8_t total = active_zones();
+
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		struct campaign_zone *zone = &campaign.zones[i];
+
+		if (zone->group_addr == BT_MESH_ADDR_UNASSIGNED || zone->state != WAVE_IDLE) {
+			continue;
+		}
+
+		if (total > 1 && running_zones() + 1 >= total) {
+			return;
+		}
+
+		if (campaign.running_nodes != 0 &&
+		    campaign.running_nodes + zone->node_count > campaign.max_concurrent) {
+			return;
+		}
+
+		wave_start(i);
+	}
+}
+
+/* Send one targeted poll for the given zone. Returns true if a message was
+ * sent, so the caller can stop for this tick.
+ */
+static bool wave_poll(uint8_t zone_idx, uint8_t missing_flag, uint8_t polled_flag)
+{
+	for (int i = 0; i < active_nodes.len; i++) {
+		uint16_t addr = active_nodes.nodes[i];
+
+		if (addr == 0 || campaign.node_zone[i] != zone_idx ||
+		    (campaign.node_flags[i] & (missing_flag | polled_flag))) {
+			continue;
+		}
+
+		campaign.node_flags[i] |= polled_flag;
+		if (missing_flag == NODE_ACKED) {
+			get_test_ack(campaign.monitor, addr);
+		} else {
+			get_test_result(campaign.monitor, addr);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+static void campaign_tick(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	bool sent = false;
+	bool pending = false;
+
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		struct campaign_zone *zone = &campaign.zones[i];
+		int64_t elapsed_s = (now - zone->started_at) / 1000;
+
+		if (zone->group_addr == BT_MESH_ADDR_UNASSIGNED) {
+			continue;
+		}
+
+		if (zone->state == WAVE_RUNNING) {
+			if (zone->reported >= zone->node_count) {
+				wave_finish(i);
+			} else if (elapsed_s >= campaign.duration +
+					       CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_POLL_DELAY) {
+				zone->state = WAVE_POLLING;
+			} else if (!sent && elapsed_s >= CAMPAIGN_ACK_WINDOW_S) {
+				/* Each silent node is asked for its ack once */
+				sent = wave_poll(i, NODE_ACKED, NODE_ACKED);
+			}
+		}
+
+		if (zone->state == WAVE_POLLING && !sent) {
+			if (zone->reported >= zone->node_count) {
+				wave_finish(i);
+			} else {
+				sent = wave_poll(i, NODE_REPORTED, NODE_POLLED);
+				if (!sent) {
+					/* Every missing node has been polled once */
+					wave_finish(i);
+				}
+			}
+		}
+
+		if (zone->state != WAVE_DONE) {
+			pending = true;
+		}
+	}
+
+	waves_fill();
+
+	if (pending) {
+		k_work_reschedule_for_queue(CAMPAIGN_WQ, &campaign_work, K_MSEC(CAMPAIGN_TICK_MS));
+	} else {
+		k_work_submit_to_queue(REPORT_WQ, &done_work);
+	}
+}
+
+void campaign_node_clear(int idx)
+{
+	campaign.node_zone[idx] = CAMPAIGN_NO_ZONE;
+}
+
+void campaign_zones_reset(void)
+{
+	memset(campaign.zones, 0, sizeof(campaign.zones));
+	memset(campaign.node_zone, CAMPAIGN_NO_ZONE, sizeof(campaign.node_zone));
+}
+
+int campaign_zone_set(uint8_t zone, uint16_t group_addr)
+{
+	if (zone >= ARRAY_SIZE(campaign.zones) || !BT_MESH_ADDR_IS_GROUP(group_addr)) {
+		return -EINVAL;
+	}
+
+	if (campaign.active) {
+		return -EBUSY;
+	}
+
+	campaign.zones[zone].group_addr = group_addr;
+	return 0;
+}
+
+int campaign_zone_node_add(uint8_t zone, uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+
+	if (zone >= ARRAY_SIZE(campaign.zones) || idx < 0) {
+		return -EINVAL;
+	}
+
+	if (campaign.active) {
+		return -EBUSY;
+	}
+
+	/* The waves only run zones with a group */
+	if (campaign.zones[zone].group_addr == BT_MESH_ADDR_UNASSIGNED) {
+		return -ENOENT;
+	}
+
+	campaign.node_zone[idx] = zone;
+	provisioner_zones_sync();
+	return 0;
+}
+
+int campaign_start(uint16_t duration, uint16_t max_concurrent)
+{
+	if (campaign.active) {
+		return -EBUSY;
+	}
+
+	if (zone_count() == 0 || max_concurrent == 0) {
+		return -EINVAL;
+	}
+
+	memset(campaign.node_flags, 0, sizeof(campaign.node_flags));
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		campaign.zones[i].node_count = 0;
+		campaign.zones[i].state = WAVE_IDLE;
+	}
+
+	/* A node outside of every defined zone would never be tested */
+	for (int i = 0; i < active_nodes.len; i++) {
+		if (active_nodes.nodes[i] != 0 &&
+		    campaign_zone_group(campaign.node_zone[i]) == BT_MESH_ADDR_UNASSIGNED) {
+			return -ENOENT;
+		}
+	}
+
+	for (int i = 0; i < active_nodes.len; i++) {
+		uint8_t zone = campaign.node_zone[i];
+
+		if (active_nodes.nodes[i] != 0) {
+			campaign.zones[zone].node_count++;
+		}
+	}
+
+	/* Zones without nodes have nothing to wait for */
+	for (int i = 0; i < ARRAY_SIZE(campaign.zones); i++) {
+		if (campaign.zones[i].group_addr != BT_MESH_ADDR_UNASSIGNED &&
+		    campaign.zones[i].node_count == 0) {
+			campaign.zones[i].state = WAVE_DONE;
+		}
+	}
+
+	campaign.duration = duration;
+	campaign.max_concurrent = max_concurrent;
+	campaign.running_nodes = 0;
+	campaign.active = true;
+	sweep_summary_start();
+
+	waves_fill();
+	k_work_reschedule_for_queue(CAMPAIGN_WQ, &campaign_work, K_MSEC(CAMPAIGN_TICK_MS));
+
+	return 0;
+}
+
+bool campaign_is_active(void)
+{
+	return campaign.active;
+}
+
+void campaign_ack_received(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+
+	if (!campaign.active || idx < 0) {
+		return;
+	}
+
+	campaign.node_flags[idx] |= NODE_ACKED;
+}
+
+void campaign_result_received(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+	uint8_t zone;
+
+	if (!campaign.active || idx < 0) {
+		return;
+	}
+
+	zone = campaign.node_zone[idx];
+	if (zone == CAMPAIGN_NO_ZONE || (campaign.node_flags[idx] & NODE_REPORTED) ||
+	    (campaign.zones[zone].state != WAVE_RUNNING &&
+	     campaign.zones[zone].state != WAVE_POLLING)) {
+		return;
+	}
+
+	campaign.node_flags[idx] |= NODE_REPORTED;
+	campaign.zones[zone].reported++;
+
+	/* Start the next wave as soon as a zone is complete */
+	if (campaign.zones[zone].reported >= campaign.zones[zone].node_count) {
+		k_work_reschedule_for_queue(CAMPAIGN_WQ, &campaign_work, K_NO_WAIT);
+	}
+}
+
+uint8_t campaign_node_zone(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+
+	return idx < 0 ? CAMPAIGN_NO_ZONE : campaign.node_zone[idx];
+}
+
+uint16_t campaign_zone_group(uint8_t zone)
+{
+	return zone < ARRAY_SIZE(campaign.zones) ? campaign.zones[zone].group_addr :
+						   BT_MESH_ADDR_UNASSIGNED;
+}
+
+bool campaign_get_start(struct bt_mesh_msg_ctx *ctx)
+{
+	int idx = active_nodes_find(ctx->addr);
+	struct campaign_zone *zone;
+
+	if (!campaign.active || idx < 0 || campaign.node_zone[idx] == CAMPAIGN_NO_ZONE) {
+		return false;
+	}
+
+	zone = &campaign.zones[campaign.node_zone[idx]];
+	if (zone->state != WAVE_RUNNING) {
+		return false;
+	}
+
+	set_light_test_start_single(campaign.monitor, ctx, campaign.duration);
+	return true;
+}
+
+void campaign_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh)
+{
+	campaign.monitor = monitor;
+	campaign.shell = sh;
+	campaign_zones_reset();
+	k_work_init_delayable(&campaign_work, campaign_tick);
+}
@@ -26,11 +26,19 @@ static int handle_test_result(struct bt_mesh_model *model, struct bt_mesh_msg_ct
 			      struct net_buf_simple *buf)
 {
 	struct bt_mesh_light_monitor *monitor = model->user_data;
-	bool *result;
+	struct light_monitor_test_result msg;
+	int err;
+
+	err = light_monitor_test_result_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
+
+	/* Pushed results are retransmitted by the server until acknowledged */
+	(void)send_result_ack(monitor, ctx, msg.seq);
 
-	result = net_buf_simple_pull_mem(buf, buf->len);
 	if (monitor->handlers->result) {
-		monitor->handlers->result(monitor, ctx, result);
+		monitor->handlers->result(monitor, ctx, &msg);
 	}
 	return 0;
 }
@@ -39,12 +47,16 @@ static int handle_test_log(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *
 			    struct net_buf_simple *buf)
 {
 	struct bt_mesh_light_monitor *monitor = model->user_data;
-	bool *result;
-	uint32_t time_stamp;
-	time_stamp = net_buf_simple_remove_le32(buf);
-	result = net_buf_simple_pull_mem(buf, 1);
+	struct light_monitor_result_log msg;
+	int err;
+
+	err = light_monitor_result_log_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
+
 	if (monitor->handlers->result_log) {
-		monitor->handlers->result_log(monitor, ctx, *result, time_stamp);
+		monitor->handlers->result_log(monitor, ctx, msg.result, msg.reported, msg.age);
 	}
 	return 0;
 }
@@ -53,11 +65,34 @@ static int handle_message_status_update(struct bt_mesh_model *model, struct bt_m
 					struct net_buf_simple *buf)
 {
 	struct bt_mesh_light_monitor *monitor = model->user_data;
-	uint16_t msg;
+	struct light_monitor_status_update msg;
+	int err;
+
+	err = light_monitor_status_update_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
 
-	msg = net_buf_simple_pull_le16(buf);
 	if (monitor->handlers->update) {
-		monitor->handlers->update(monitor, ctx, msg);
+		monitor->handlers->update(monitor, ctx, msg.value);
+	}
+	return 0;
+}
+
+static int handle_test_progress(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+				struct net_buf_simple *buf)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct light_monitor_test_progress msg;
+	int err;
+
+	err = light_monitor_test_progress_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
+
+	if (monitor->handlers->progress) {
+		monitor->handlers->progress(monitor, ctx, &msg);
 	}
 	return 0;
 }
@@ -77,8 +112,34 @@ static int handle_calibrate_ok(struct bt_mesh_model *model, struct bt_mesh_msg_c
 				 struct net_buf_simple *buf)
 {
 	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct light_monitor_calibrate_status status;
+	int err;
+
+	err = light_monitor_calibrate_status_decode(buf, &status);
+	if (err) {
+		return err;
+	}
+
 	if (monitor->handlers->calibrate_ok) {
-		monitor->handlers->calibrate_ok(monitor, ctx);
+		monitor->handlers->calibrate_ok(monitor, ctx, &status);
+	}
+	return 0;
+}
+
+static int handle_schedule_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+				  struct net_buf_simple *buf)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct test_schedule schedule;
+	int err;
+
+	err = light_monitor_schedule_decode(buf, &schedule);
+	if (err) {
+		return err;
+	}
+
+	if (monitor->handlers->schedule_status) {
+		monitor->handlers->schedule_status(monitor, ctx, &schedule);
 	}
 	return 0;
 }
@@ -89,20 +150,29 @@ const struct bt_mesh_model_op _bt_mesh_light_monitor_op[] = {
 	{ UPDATE_STATUS_OPCODE, STATUS_UPDATE_LEN, handle_message_status_update },
 	{ RESULT_LOG_OPCODE, RESULT_LOG_LEN, handle_test_log },
 	{ GET_START_OPCODE, GET_START_LEN, handle_test_start_get },
-	{ CALIBRATE_OK_OPCODE, CALIBRATE_LEN, handle_calibrate_ok },
+	{ CALIBRATE_OK_OPCODE, CALIBRATE_OK_LEN, handle_calibrate_ok },
+	{ SCHEDULE_STATUS_OPCODE, SCHEDULE_STATUS_LEN, handle_schedule_status },
+	{ TEST_PROGRESS_OPCODE, TEST_PROGRESS_LEN, handle_test_progress },
 	BT_MESH_MODEL_OP_END,
 };
-uint16_t msg;
-bool result_msg;
 
-int set_light_test_start(struct bt_mesh_light_monitor *monitor, uint16_t test_duration,
-			 uint32_t timestamp)
+static int request_send(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+			struct net_buf_simple *buf)
 {
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	int err = bt_mesh_model_send(monitor->model, ctx, buf, NULL, NULL);
 
-	bt_mesh_model_msg_init(buf, TEST_START_OPCODE);
-	net_buf_simple_add_le16(buf, test_duration);
-	net_buf_simple_add_le32(buf, timestamp);
+	if (!err && monitor->handlers->request_sent) {
+		monitor->handlers->request_sent(monitor, ctx->addr);
+	}
+
+	return err;
+}
+
+int set_light_test_start(struct bt_mesh_light_monitor *monitor, uint16_t test_duration)
+{
+	struct light_monitor_test_start msg = { .duration = test_duration };
+
+	light_monitor_test_start_encode(monitor->model->pub->msg, &msg);
 
 	return bt_mesh_model_publish(monitor->model);
 }
@@ -115,27 +185,35 @@ int get_test_result(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 		.send_ttl = BT_MESH_TTL_DEFAULT,
 		.send_rel = false,
 	};
-	BT_MESH_MODEL_BUF_DEFINE(buf, GET_RESULT_OPCODE,
-				 BT_MESH_LIGHT_MONITOR_MSG_LEN_MESSAGE_REPLY);
+	BT_MESH_MODEL_BUF_DEFINE(buf, GET_RESULT_OPCODE, GET_RESULT_LEN);
 	bt_mesh_model_msg_init(&buf, GET_RESULT_OPCODE);
 
-	return bt_mesh_model_send(monitor->model, &ctx, &buf, NULL, NULL);
+	return request_send(monitor, &ctx, &buf);
 }
 
 int set_light_test_start_single(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-				uint16_t test_duration, uint32_t timestamp)
+				uint16_t test_duration)
 {
-	BT_MESH_MODEL_BUF_DEFINE(buf, TEST_START_OPCODE, 6);
+	struct light_monitor_test_start msg = { .duration = test_duration };
+	BT_MESH_MODEL_BUF_DEFINE(buf, TEST_START_OPCODE, TEST_START_LEN);
 
-	bt_mesh_model_msg_init(&buf, TEST_START_OPCODE);
-	net_buf_simple_add_le16(&buf, test_duration);
-	net_buf_simple_add_le32(&buf, timestamp);
+	light_monitor_test_start_encode(&buf, &msg);
 
 	(void)bt_mesh_model_send(monitor->model, ctx, &buf, NULL, NULL);
 
 	return 0;
 }
 
+int send_result_ack(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+		    uint16_t seq)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, RESULT_ACK_OPCODE, RESULT_ACK_LEN);
+
+	light_monitor_result_ack_encode(&buf, seq);
+
+	return bt_mesh_model_send(monitor->model, ctx, &buf, NULL, NULL);
+}
+
 int get_test_ack(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 {
 	struct bt_mesh_msg_ctx ctx = {
@@ -144,12 +222,13 @@ int get_test_ack(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 		.send_ttl = BT_MESH_TTL_DEFAULT,
 		.send_rel = false,
 	};
-	BT_MESH_MODEL_BUF_DEFINE(buf, GET_ACK_OPCODE, BT_MESH_LIGHT_MONITOR_MSG_LEN_MESSAGE_REPLY);
+	BT_MESH_MODEL_BUF_DEFINE(buf, GET_ACK_OPCODE, GET_ACK_LEN);
 	bt_mesh_model_msg_init(&buf, GET_ACK_OPCODE);
-	return bt_mesh_model_send(monitor->model, &ctx, &buf, NULL, NULL);
+	return request_send(monitor, &ctx, &buf);
 }
 
-int calibrate_node(struct bt_mesh_light_monitor *monitor, uint16_t addr)
+int calibrate_node(struct bt_mesh_light_monitor *monitor, uint16_t addr,
+		   const struct light_monitor_calibrate *msg)
 {
 	struct bt_mesh_msg_ctx ctx = {
 		.addr = addr,
@@ -158,8 +237,33 @@ int calibrate_node(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 		.send_rel = false,
 	};
 	BT_MESH_MODEL_BUF_DEFINE(buf, CALIBRATE_OPCODE, CALIBRATE_LEN);
-	bt_mesh_model_msg_init(&buf, CALIBRATE_OPCODE);
-	return bt_mesh_model_send(monitor->model, &ctx, &buf, NULL, NULL);
+
+	light_monitor_calibrate_encode(&buf, msg);
+
+	return request_send(monitor, &ctx, &buf);
+}
+
+int calibrate_all(struct bt_mesh_light_monitor *monitor, const struct light_monitor_calibrate *msg)
+{
+	light_monitor_calibrate_encode(monitor->model->pub->msg, msg);
+
+	return bt_mesh_model_publish(monitor->model);
+}
+
+int set_test_schedule(struct bt_mesh_light_monitor *monitor, uint16_t addr,
+		      const struct test_schedule *schedule)
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.addr = addr,
+		.app_idx = monitor->model->keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+		.send_rel = false,
+	};
+	BT_MESH_MODEL_BUF_DEFINE(buf, SCHEDULE_SET_OPCODE, SCHEDULE_SET_LEN);
+
+	light_monitor_schedule_encode(&buf, SCHEDULE_SET_OPCODE, schedule);
+
+	return request_send(monitor, &ctx, &buf);
 }
 
 int get_status(struct bt_mesh_light_monitor *monitor)
@@ -171,6 +275,20 @@ int get_status(struct bt_mesh_light_monitor *monitor)
 	return bt_mesh_model_publish(monitor->model);
 }
 
+int get_status_single(struct bt_mesh_light_monitor *monitor, uint16_t addr)
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.addr = addr,
+		.app_idx = monitor->model->keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+		.send_rel = false,
+	};
+	BT_MESH_MODEL_BUF_DEFINE(buf, GET_STATUS_OPCODE, GET_STATUS_LEN);
+	bt_mesh_model_msg_init(&buf, GET_STATUS_OPCODE);
+
+	return request_send(monitor, &ctx, &buf);
+}
+
 int get_result_log(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 {
 	struct bt_mesh_msg_ctx ctx = {
@@ -178,10 +296,10 @@ int get_result_log(struct bt_mesh_light_monitor *monitor, uint16_t addr)
 		/*.send_rel = false, */
 
 	};
-	BT_MESH_MODEL_BUF_DEFINE(buf, GET_LOG_OPCODE, 2);
+	BT_MESH_MODEL_BUF_DEFINE(buf, GET_LOG_OPCODE, GET_LOG_LEN);
 	bt_mesh_model_msg_init(&buf, GET_LOG_OPCODE);
 
-	return bt_mesh_model_send(monitor->model, &ctx, &buf, NULL, NULL);
+	return request_send(monitor, &ctx, &buf);
 }
 
 static int bt_mesh_light_monitor_update_handler(struct bt_mesh_model *model)
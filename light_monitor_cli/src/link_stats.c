@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+#include "model_handler.h"
+#include "link_stats.h"
+#include "light_monitor_workq.h"
+
+/* Requests after which the counts are halved, so old ones fade out */
+#define LINK_WINDOW 32
+/* Weight of a new RSSI sample in the average, as a power of two */
+#define RSSI_WEIGHT_LOG 3
+/* The RSSI is averaged in 1/16 dBm */
+#define RSSI_SCALE 16
+#define ENTRIES_PER_LINE 32
+#define ENTRY_LEN 4
+#define RATE_UNKNOWN 0xff
+#define LINK_STATS_PERIOD K_SECONDS(CONFIG_BT_MESH_LIGHT_MONITOR_LINK_STATS_PERIOD)
+#define LINK_STATS_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG)
+
+struct link_entry {
+	int16_t rssi;
+	uint8_t ttl;
+	uint8_t hops;
+	uint8_t requests;
+	uint8_t replies;
+	uint8_t retries;
+	bool heard;
+};
+
+/* By roster index, cleared when the index is given to another node */
+static struct link_entry links[ROSTER_SIZE];
+/* Nodes that haven't answered their last request */
+static ATOMIC_DEFINE(awaiting, ROSTER_SIZE);
+static const struct shell *links_shell;
+/* Only written from the log work queue, which prints every table */
+static char hex[ENTRIES_PER_LINE * ENTRY_LEN * 2 + 1];
+
+static void export_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(export_work, export_work_handler);
+
+void link_stats_clear(int idx)
+{
+	memset(&links[idx], 0, sizeof(links[idx]));
+	atomic_clear_bit(awaiting, idx);
+}
+
+void link_stats_rx(const struct bt_mesh_msg_ctx *ctx)
+{
+	int idx = active_nodes_find(ctx->addr);
+	uint8_t ttl_default = bt_mesh_default_ttl_get();
+	struct link_entry *entry;
+
+	if (idx < 0) {
+		return;
+	}
+
+	entry = &links[idx];
+	if (!entry->heard) {
+		entry->rssi = ctx->recv_rssi * RSSI_SCALE;
+		entry->heard = true;
+	} else {
+		entry->rssi += (ctx->recv_rssi * RSSI_SCALE - entry->rssi) >> RSSI_WEIGHT_LOG;
+	}
+
+	/* Messages sent with TTL 0 aren't relayed. Otherwise the nodes are
+	 * assumed to send with the same default TTL as the gateway.
+	 */
+	entry->ttl = ctx->recv_ttl;
+	if (ctx->recv_ttl == 0) {
+		entry->hops = 1;
+	} else if (ctx->recv_ttl <= ttl_default) {
+		entry->hops = ttl_default - ctx->recv_ttl + 1;
+	}
+
+	if (atomic_test_and_clear_bit(awaiting, idx)) {
+		entry->replies++;
+	}
+}
+
+void link_stats_request(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+	struct link_entry *entry;
+
+	if (idx < 0) {
+		return;
+	}
+
+	entry = &links[idx];
+	if (entry->requests >= LINK_WINDOW) {
+		entry->requests /= 2;
+		entry->replies /= 2;
+		entry->retries /= 2;
+	}
+
+	entry->requests++;
+	if (atomic_test_and_set_bit(awaiting, idx)) {
+		entry->retries++;
+	}
+}
+
+void link_stats_hops_set(int idx, uint8_t hops)
+{
+	if (hops != LINK_STATS_HOPS_UNKNOWN) {
+		links[idx].hops = hops;
+	}
+}
+
+int8_t link_stats_rssi(int idx)
+{
+	if (!links[idx].heard) {
+		return LINK_STATS_RSSI_UNKNOWN;
+	}
+
+	return links[idx].rssi / RSSI_SCALE;
+}
+
+uint8_t link_stats_ttl(int idx)
+{
+	return links[idx].ttl;
+}
+
+static void entry_encode(int idx, uint8_t out[ENTRY_LEN])
+{
+	const struct link_entry *entry = &links[idx];
+
+	out[0] = (uint8_t)link_stats_rssi(idx);
+	out[1] = entry->hops;
+	out[2] = entry->requests ? MIN(entry->replies, entry->requests) * 100 / entry->requests :
+				   RATE_UNKNOWN;
+	out[3] = entry->retries;
+}
+
+static int table_print(void)
+{
+	uint8_t line[ENTRIES_PER_LINE * ENTRY_LEN];
+	uint32_t crc = roster_crc();
+	int len = active_nodes.len;
+
+	if (len == 0) {
+		return -ENOENT;
+	}
+
+	for (int first = 0; first < len; first += ENTRIES_PER_LINE) {
+		int count = MIN(len - first, ENTRIES_PER_LINE);
+
+		for (int i = 0; i < count; i++) {
+			entry_encode(first + i, &line[i * ENTRY_LEN]);
+		}
+
+		if (!bin2hex(line, count * ENTRY_LEN, hex, sizeof(hex))) {
+			return -ENOMEM;
+		}
+
+		shell_print(links_shell, "links %08x %d %d %s", crc, len, first, hex);
+	}
+
+	return 0;
+}
+
+static void export_work_handler(struct k_work *work)
+{
+	(void)table_print();
+	if (CONFIG_BT_MESH_LIGHT_MONITOR_LINK_STATS_PERIOD) {
+		k_work_reschedule_for_queue(LINK_STATS_WQ, &export_work, LINK_STATS_PERIOD);
+	}
+}
+
+int link_stats_print(void)
+{
+	if (active_nodes.len == 0) {
+		return -ENOENT;
+	}
+
+	/* The next periodic export is counted from this one */
+	k_work_reschedule_for_queue(LINK_STATS_WQ, &export_work, K_NO_WAIT);
+	return 0;
+}
+
+void link_stats_init(const struct shell *sh)
+{
+	links_shell = sh;
+
+	if (CONFIG_BT_MESH_LIGHT_MONITOR_LINK_STATS_PERIOD) {
+		k_work_reschedule_for_queue(LINK_STATS_WQ, &export_work, LINK_STATS_PERIOD);
+	}
+}
@@ -12,6 +12,8 @@
 #include <bluetooth/mesh/dk_prov.h>
 #include <dk_buttons_and_leds.h>
 #include "model_handler.h"
+#include "light_monitor_workq.h"
+#include "provisioner.h"
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(chat, CONFIG_LOG_DEFAULT_LEVEL);
@@ -28,7 +30,11 @@ static void bt_ready(int err)
 	dk_leds_init();
 	dk_buttons_init(NULL);
 
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROVISIONER
+	err = bt_mesh_init(provisioner_prov_init(), model_handler_init());
+#else
 	err = bt_mesh_init(bt_mesh_dk_prov_init(), model_handler_init());
+#endif
 	if (err) {
 		printk("Initializing mesh failed (err %d)\n", err);
 		return;
@@ -50,6 +56,8 @@ int main(void)
 
 	printk("Initializing...\n");
 
+	light_monitor_workq_init();
+
 	err = bt_enable(bt_ready);
 	if (err) {
 		printk("Bluetooth init failed (err %d)\n", err);
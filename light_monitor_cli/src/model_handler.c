@@ -15,6 +15,15 @@
 
 #include "light_monitor_cli.h"
 #include "model_handler.h"
+#include "campaign.h"
+#include "calibration.h"
+#include "relay_prune.h"
+#include "sweep_summary.h"
+#include "result_ring.h"
+#include "node_cache.h"
+#include "link_stats.h"
+#include "provisioner.h"
+#include "light_monitor_workq.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
@@ -25,6 +34,8 @@
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/gpio.h>
 /*#include <power/reboot.h>*/
 
@@ -41,18 +52,68 @@
 
 #define THRESHOLD_VALUE 3500
 #define DIGITAL_PIN 29
+/* The Configuration Client blocks until the node answers, so its requests run
+ * on their own thread, one at a time, instead of holding up the other queues.
+ */
+#define CFG_CLI_STACK_SIZE 2048
+#define CFG_CLI_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+/* Polls of the nodes go out ahead of host output, the LEDs after everything else */
+#define REPLY_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
+#define LOG_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG)
 
 const struct device *uart = DEVICE_DT_GET(DT_NODELABEL(uart0));
 static const struct device *gpio_dev;
 static struct bt_mesh_light_monitor monitor;
 bool nodes_list_reading_active = false;
 struct NodesList active_nodes;
-bool ack_list[1024] = { 0 };
-bool res_list[1024] = { 0 };
+/* Nodes that acked the running test, and whose result arrived, by roster index */
+static ATOMIC_DEFINE(ack_list, ROSTER_SIZE);
+static ATOMIC_DEFINE(res_list, ROSTER_SIZE);
 bool test_running = false;
 int err;
 
 static const struct shell *monitor_shell;
+
+K_THREAD_STACK_DEFINE(cfg_cli_stack, CFG_CLI_STACK_SIZE);
+static struct k_work_q cfg_cli_wq;
+
+struct k_work_q *cfg_cli_workq(void)
+{
+	return &cfg_cli_wq;
+}
+
+void roster_bitmap_clear(atomic_t *bitmap)
+{
+	for (int i = 0; i < ATOMIC_BITMAP_SIZE(ROSTER_SIZE); i++) {
+		atomic_clear(&bitmap[i]);
+	}
+}
+
+uint32_t roster_crc(void)
+{
+	uint32_t crc = 0;
+
+	for (int i = 0; i < active_nodes.len; i++) {
+		uint8_t addr[2];
+
+		sys_put_le16(active_nodes.nodes[i], addr);
+		crc = crc32_ieee_update(crc, addr, sizeof(addr));
+	}
+
+	return crc;
+}
+
+/* The roster is filled in by the host */
+int active_nodes_find(uint16_t addr)
+{
+	for (int i = 0; i < active_nodes.len; i++) {
+		if (active_nodes.nodes[i] == addr && addr != 0) {
+			return i;
+		}
+	}
+
+	return -ENOENT;
+}
 /******************************************************************************/
 /*************************** Health server setup ******************************/
 /******************************************************************************/
@@ -74,7 +135,7 @@ static void attention_blink(struct k_work *work)
 
 	if (attention) {
 		dk_set_leds(pattern[idx++ % ARRAY_SIZE(pattern)]);
-		k_work_reschedule(&attention_blink_work, K_MSEC(30));
+		k_work_reschedule_for_queue(LOG_WQ, &attention_blink_work, K_MSEC(30));
 	} else {
 		dk_set_leds(DK_NO_LEDS_MSK);
 	}
@@ -83,7 +144,7 @@ static void attention_blink(struct k_work *work)
 static void attention_on(struct bt_mesh_model *mod)
 {
 	attention = true;
-	k_work_reschedule(&attention_blink_work, K_NO_WAIT);
+	k_work_reschedule_for_queue(LOG_WQ, &attention_blink_work, K_NO_WAIT);
 }
 
 static void attention_off(struct bt_mesh_model *mod)
@@ -103,10 +164,65 @@ static struct bt_mesh_health_srv health_srv = {
 
 BT_MESH_HEALTH_PUB_DEFINE(health_pub, 0);
 /******************************************************************************/
+/**************************** Time models setup *******************************/
+/******************************************************************************/
+/* The gateway is the time authority of the network. It takes its time from the
+ * host and publishes it to the Time Servers of the nodes, which then stamp
+ * their results locally. The nodes are Time Clients, so they take the time
+ * but don't pass it on.
+ */
+/* Current difference between TAI and UTC in seconds */
+#define TAI_UTC_DELTA 37
+/* Uncertainty of the host time in steps of 10 ms */
+#define HOST_TIME_UNCERTAINTY 100
+
+static struct bt_mesh_time_srv time_srv = BT_MESH_TIME_SRV_INIT(NULL);
+
+static void handle_time_status(struct bt_mesh_time_cli *cli, struct bt_mesh_msg_ctx *ctx,
+			       const struct bt_mesh_time_status *status);
+
+static const struct bt_mesh_time_cli_handlers time_cli_handlers = {
+	.time_status = handle_time_status,
+};
+
+static struct bt_mesh_time_cli time_cli = BT_MESH_TIME_CLI_INIT(&time_cli_handlers);
+
+static uint32_t tai_to_unix(const struct bt_mesh_time_status *status)
+{
+	return status->tai_sec + MESH_TAI_EPOCH_UNIX - status->tai_utc_delta;
+}
+
+uint32_t current_time_stamp(void)
+{
+	struct bt_mesh_time_status status;
+
+	if (bt_mesh_time_srv_status(&time_srv, k_uptime_get(), &status)) {
+		return 0;
+	}
+
+	return tai_to_unix(&status);
+}
+
+static int gateway_time_set(uint32_t unix_time)
+{
+	struct bt_mesh_time_status status = {
+		.tai_sec = (uint64_t)unix_time - MESH_TAI_EPOCH_UNIX + TAI_UTC_DELTA,
+		.uncertainty = HOST_TIME_UNCERTAINTY,
+		.tai_utc_delta = TAI_UTC_DELTA,
+		.is_authority = true,
+	};
+
+	bt_mesh_time_srv_time_set(&time_srv, k_uptime_get(), &status);
+
+	/* Push the new time to the nodes right away instead of waiting for the
+	 * next periodic publication.
+	 */
+	return bt_mesh_time_srv_time_status_send(&time_srv, NULL);
+}
+/******************************************************************************/
 /**************************** peripheral setup ********************************/
 /******************************************************************************/
 /*The uart is configured and logic for the test is handled here*/
-uint32_t this_test_timestamp;
 uint16_t this_test_duration;
 uint16_t ack_idx;
 
@@ -119,16 +235,9 @@ struct k_timer result_timer;
 struct k_work result_work;
 K_WORK_DEFINE(result_work, result_checker);
 
-static void set_array_to_false(bool array[])
-{
-	for (int x = 0; x < active_nodes.len; x++) {
-		array[active_nodes.nodes[x]] = false;
-	}
-}
-
 static void ack_work_handler(struct k_timer *timer)
 {
-	k_work_submit(&ack_work);
+	k_work_submit_to_queue(REPLY_WQ, &ack_work);
 }
 
 static struct k_work_delayable sched_ack_work;
@@ -140,25 +249,24 @@ static void sched_ack_work_cb(struct k_work *work)
 
 static void ack_checker()
 {
-	if (active_nodes.nodes[ack_idx] == 0) {
+	if (active_nodes.len == 0) {
 		shell_print(monitor_shell, "Empty nodes list \n");
-	} else if (ack_list[active_nodes.nodes[ack_idx]] == false) {
+	} else if (!atomic_test_bit(ack_list, ack_idx)) {
 		get_test_ack(&monitor, active_nodes.nodes[ack_idx]);
 		shell_print(monitor_shell, "Get test ack for node %d\n", active_nodes.nodes[ack_idx]);
 	}
 
-	if (ack_idx >= active_nodes.len) {
+	if (++ack_idx >= active_nodes.len) {
 		ack_idx = 0;
-		set_array_to_false(ack_list);
+		roster_bitmap_clear(ack_list);
 	} else {
-		ack_idx++;
-		k_work_reschedule(&sched_ack_work, K_MSEC(500));
+		k_work_reschedule_for_queue(REPLY_WQ, &sched_ack_work, K_MSEC(500));
 	}
 }
 
 static void result_work_handler(struct k_timer *timer)
 {
-	k_work_submit(&result_work);
+	k_work_submit_to_queue(REPLY_WQ, &result_work);
 }
 
 static struct k_work_delayable sched_res_work;
@@ -170,32 +278,40 @@ static void sched_res_work_cb(struct k_work *work)
 
 static void result_checker()
 {
-	if (active_nodes.nodes[ack_idx] == 0) {
+	/* Nodes whose pushed result already arrived need no round trip */
+	while (ack_idx < active_nodes.len && atomic_test_bit(res_list, ack_idx)) {
+		ack_idx++;
+	}
+
+	if (active_nodes.len == 0) {
 		shell_print(monitor_shell, "Empty nodes list\n");
-	} else if (res_list[active_nodes.nodes[ack_idx]] == false) {
+	} else if (ack_idx < active_nodes.len) {
 		get_test_result(&monitor, active_nodes.nodes[ack_idx]);
 		shell_print(monitor_shell, "Get test result for node %d\n", active_nodes.nodes[ack_idx]);
+		ack_idx++;
 	}
+
 	if (ack_idx >= active_nodes.len) {
 		ack_idx = 0;
 		test_running = false;
-		set_array_to_false(res_list);
+		roster_bitmap_clear(res_list);
+		sweep_summary_finish();
 	} else {
-		ack_idx++;
-		k_work_reschedule(&sched_res_work, K_MSEC(1000));
+		k_work_reschedule_for_queue(REPLY_WQ, &sched_res_work, K_MSEC(1000));
 	}
 }
 
-static int test_start(uint16_t duration, uint32_t time)
+static int test_start(uint16_t duration)
 {
 	ack_idx = 0;
 	test_running = true;
-	set_light_test_start(&monitor, duration, time);
+	sweep_summary_start();
+	set_light_test_start(&monitor, duration);
 	k_timer_init(&ack_timer, ack_work_handler, NULL);
 	k_timer_start(&ack_timer, K_SECONDS(2), K_NO_WAIT);
 	k_timer_init(&result_timer, result_work_handler, NULL);
-	k_timer_start(&result_timer, K_SECONDS(duration + 5), K_NO_WAIT);
-	this_test_timestamp = time;
+	k_timer_start(&result_timer,
+		      K_SECONDS(duration + CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_POLL_DELAY), K_NO_WAIT);
 	this_test_duration = duration;
 	return 0;
 }
@@ -240,38 +356,120 @@ static void handle_status_update(struct bt_mesh_light_monitor *monitor, struct b
 				 uint16_t msg)
 {
 	shell_print(monitor_shell, "status %d %d", ctx->addr, msg);
+	node_cache_status(ctx->addr, msg);
+	link_stats_rx(ctx);
 }
 
 static void handle_result(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-			  bool *result)
+			  const struct light_monitor_test_result *result)
 {
-	shell_print(monitor_shell, "result %d %s", ctx->addr,  *result ? "passed" : "failed");
-	res_list[ctx->addr] = true;
+	int idx = active_nodes_find(ctx->addr);
+	uint32_t time_stamp;
+
+	/* Every result is stamped once, by the gateway clock, and the host
+	 * files it under that stamp whichever way it gets it. Results of a
+	 * sweep are stamped with the start of the sweep, and reported all at
+	 * once when it ends. The supply and switchover of every node aren't in
+	 * the sweep record, and are always printed.
+	 */
+	if (sweep_summary_active()) {
+		time_stamp = sweep_summary_time_stamp();
+		sweep_summary_result(ctx->addr, result->result);
+	} else {
+		time_stamp = current_time_stamp();
+		shell_print(monitor_shell, "result %d %s %u", ctx->addr,
+			    result->result ? "passed" : "failed", time_stamp);
+	}
+
+	shell_print(monitor_shell, "supply %d %d %d", ctx->addr, result->vdd_mv, result->batt_mv);
+	if (result->light_delay == LIGHT_DELAY_NONE) {
+		shell_print(monitor_shell, "switchover %d -", ctx->addr);
+	} else {
+		shell_print(monitor_shell, "switchover %d %u", ctx->addr,
+			    result->light_delay * LIGHT_DELAY_UNIT_US);
+	}
+	(void)result_ring_append(ctx->addr, result->result, time_stamp);
+	node_cache_result(ctx->addr, result->result);
+	if (idx >= 0) {
+		atomic_set_bit(res_list, idx);
+	}
+	campaign_result_received(ctx->addr);
+	link_stats_rx(ctx);
 
 }
 
+static void handle_test_progress(struct bt_mesh_light_monitor *monitor,
+				 struct bt_mesh_msg_ctx *ctx,
+				 const struct light_monitor_test_progress *progress)
+{
+	shell_print(monitor_shell, "progress %d %d %d %d %d", ctx->addr, progress->elapsed,
+		    progress->darkest, progress->current, progress->margin);
+	node_cache_status(ctx->addr, progress->current);
+	link_stats_rx(ctx);
+}
+
 static int handle_test_ack(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
 {
+	int idx = active_nodes_find(ctx->addr);
+
 	shell_print(monitor_shell, "acking %d waiting", ctx->addr);
 
-	ack_list[ctx->addr] = true;
+	if (idx >= 0) {
+		atomic_set_bit(ack_list, idx);
+	}
+	campaign_ack_received(ctx->addr);
+	node_cache_seen(ctx->addr);
+	link_stats_rx(ctx);
 	return 0;
 }
 
 static int handle_get_start(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
 {
-	set_light_test_start_single(monitor, ctx, this_test_duration, this_test_timestamp);
+	if (campaign_is_active()) {
+		/* Nodes of waves that are not running must not start early */
+		campaign_get_start(ctx);
+		return 0;
+	}
+
+	set_light_test_start_single(monitor, ctx, this_test_duration);
 	return 0;
 }
 
 static int handle_result_log(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-			      bool result, uint32_t time_stamp)
+			      bool result, bool reported, uint32_t age)
 {
-	shell_print(monitor_shell, "logged %d %u %d \n", result, time_stamp, ctx->addr);
+	uint32_t now = current_time_stamp();
+	uint32_t time_stamp = 0;
+
+	/* Rounded to whole minutes, so the host sees the same timestamp every
+	 * time the entry is retrieved. Entries of unknown age are printed with
+	 * a zero timestamp.
+	 */
+	if (age != RESULT_LOG_AGE_UNKNOWN && now / 60 >= age) {
+		time_stamp = (now / 60 - age) * 60;
+	}
+
+	/* A result the gateway acknowledged is already in the ring under its
+	 * own stamp, it is only printed for the log of the node.
+	 */
+	shell_print(monitor_shell, "logged %d %u %d %d\n", result, time_stamp, ctx->addr,
+		    reported);
+	if (!reported) {
+		(void)result_ring_append(ctx->addr, result, time_stamp);
+	}
+	node_cache_log(ctx->addr, time_stamp);
+	link_stats_rx(ctx);
 
 	return 0;
 }
 
+static void handle_time_status(struct bt_mesh_time_cli *cli, struct bt_mesh_msg_ctx *ctx,
+			       const struct bt_mesh_time_status *status)
+{
+	shell_print(monitor_shell, "time %d %u %d", ctx->addr, tai_to_unix(status),
+		    status->uncertainty);
+}
+
 static void handle_series_entry(struct bt_mesh_sensor_cli *cli, struct bt_mesh_msg_ctx *ctx,
 				const struct bt_mesh_sensor_type *sensor, uint8_t index,
 				uint8_t count, const struct bt_mesh_sensor_series_entry *entry)
@@ -283,24 +481,51 @@ static void handle_sensor_data(struct bt_mesh_sensor_cli *cli, struct bt_mesh_ms
 			       const struct bt_mesh_sensor_type *sensor,
 			       const struct sensor_value *value)
 {
-	uint16_t msg;
-	msg = value->val1;
-	shell_print(monitor_shell, "status %d %d", ctx->addr, msg);
+	/* The Sensor Server reports the illuminance in lux, not the LDR
+	 * resistance of the status message, so it isn't cached with it.
+	 */
+	shell_print(monitor_shell, "lux %d %d", ctx->addr, value->val1);
+	link_stats_rx(ctx);
+}
+
+static void handle_calibrate_ok(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+				const struct light_monitor_calibrate_status *status)
+{
+	/* Answers to a roster calibration are reported all at once when it ends */
+	if (!calibration_received(ctx->addr, status)) {
+		shell_print(monitor_shell, "calibrated %d %d %d", ctx->addr, status->threshold,
+			    status->noise);
+	}
+	node_cache_seen(ctx->addr);
+	link_stats_rx(ctx);
 }
 
-static void handle_calibrate_ok(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
+static void handle_schedule_status(struct bt_mesh_light_monitor *monitor,
+				   struct bt_mesh_msg_ctx *ctx,
+				   const struct test_schedule *schedule)
 {
-	shell_print(monitor_shell, "calibrate is ok for node %d \n", ctx->addr);
+	shell_print(monitor_shell, "schedule %d %d %d %d %d %d", ctx->addr, schedule->fn_period,
+		    schedule->fn_duration, schedule->full_period, schedule->full_duration,
+		    schedule->offset);
+	link_stats_rx(ctx);
+}
+
+static void handle_request_sent(struct bt_mesh_light_monitor *monitor, uint16_t addr)
+{
+	link_stats_request(addr);
 }
 
 static const struct bt_light_monitor_handlers monitor_handlers = {
 	.start = handle_start,
 	.update = handle_status_update,
 	.result = handle_result,
+	.progress = handle_test_progress,
 	.test_ack = handle_test_ack,
 	.result_log = handle_result_log,
 	.get_start = handle_get_start,
-	.calibrate_ok = handle_calibrate_ok
+	.calibrate_ok = handle_calibrate_ok,
+	.schedule_status = handle_schedule_status,
+	.request_sent = handle_request_sent,
 
 };
 
@@ -314,10 +539,16 @@ static struct bt_mesh_light_monitor monitor = {
 	.sensor_cli.cb = &sensor_handlers,
 };
 
+static struct bt_mesh_cfg_cli cfg_cli;
+
 static struct bt_mesh_elem elements[] = {
 	BT_MESH_ELEM(1,
 		     BT_MESH_MODEL_LIST(BT_MESH_MODEL_CFG_SRV,
-					BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub)),
+					BT_MESH_MODEL_CFG_CLI(&cfg_cli),
+					BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub),
+					BT_MESH_MODEL_TIME_SRV(&time_srv),
+					BT_MESH_MODEL_TIME_CLI(&time_cli),
+					BT_MESH_MODEL_SENSOR_CLI(&monitor.sensor_cli)),
 		     BT_MESH_MODEL_LIST(BT_MESH_MODEL_LIGHT_MONITOR(&monitor))),
 };
 
@@ -336,8 +567,10 @@ static int cmd_test_start(const struct shell *shell, size_t argc, char *argv[])
 		msg_duration = strtol(argv[1], NULL, 0);
 		msg_value = strtol(argv[2], NULL, 0);
 
-		if (test_running == false) {
-			test_start(msg_duration, msg_value);
+		if (test_running == false && !campaign_is_active()) {
+			/* The nodes stamp their results with the synchronised time */
+			gateway_time_set(msg_value);
+			test_start(msg_duration);
 		} else {
 			shell_print(monitor_shell, "Test is already running \n");
 		}
@@ -347,7 +580,28 @@ static int cmd_test_start(const struct shell *shell, size_t argc, char *argv[])
 
 static int cmd_get_status(const struct shell *shell, size_t argc, char *argv[])
 {
-	get_status(&monitor);
+	uint32_t max_age = CONFIG_BT_MESH_LIGHT_MONITOR_STATUS_MAX_AGE;
+
+	if (argc > 1) {
+		max_age = strtoul(argv[1], NULL, 0);
+	}
+
+	err = node_cache_query(max_age);
+	if (err) {
+		shell_print(monitor_shell, "Could not get the status (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_cache(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint16_t addr = strtol(argv[1], NULL, 0);
+
+	err = node_cache_print(addr);
+	if (err) {
+		shell_print(monitor_shell, "Node %d is not in the roster\n", addr);
+	}
 
 	return 0;
 }
@@ -393,46 +647,311 @@ static int cmd_portok(const struct shell *shell, size_t argc, char *argv[])
 
 static int cmd_reset_nodes(const struct shell *shell, size_t argc, char *argv[])
 {
-	active_nodes.nodes[0] = 0;
 	active_nodes.len = 0;
 
 	return 0;
 }
 
+static void roster_add(uint16_t addr)
+{
+	if (active_nodes.len >= ARRAY_SIZE(active_nodes.nodes)) {
+		shell_print(monitor_shell, "Roster is full, node %d not added\n", addr);
+		return;
+	}
+
+	/* Whatever was known of the previous node at this index is stale */
+	atomic_clear_bit(ack_list, active_nodes.len);
+	atomic_clear_bit(res_list, active_nodes.len);
+	node_cache_clear(active_nodes.len);
+	link_stats_clear(active_nodes.len);
+	provisioner_zone_clear(active_nodes.len);
+	campaign_node_clear(active_nodes.len);
+	active_nodes.nodes[active_nodes.len++] = addr;
+}
+
 static int cmd_add_first_node(const struct shell *shell, size_t argc, char *argv[])
 {
+	active_nodes.len = 0;
+	roster_add(strtol(argv[1], NULL, 0));
+
+	return 0;
+}
+
+static int cmd_add_node(const struct shell *shell, size_t argc, char *argv[])
+{
+	roster_add(strtol(argv[1], NULL, 0));
+
+	return 0;
+}
+
+
+static int cmd_zone_reset(const struct shell *shell, size_t argc, char *argv[])
+{
+	campaign_zones_reset();
+
+	return 0;
+}
+
+static int cmd_zone(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint8_t zone;
+	uint16_t group_addr;
+
+	zone = strtol(argv[1], NULL, 0);
+	group_addr = strtol(argv[2], NULL, 0);
+	err = campaign_zone_set(zone, group_addr);
+	if (err) {
+		shell_print(monitor_shell, "Could not set zone %d (err %d)\n", zone, err);
+	}
+
+	return 0;
+}
+
+static int cmd_zone_node(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint8_t zone;
+	uint16_t addr;
+
+	zone = strtol(argv[1], NULL, 0);
+	addr = strtol(argv[2], NULL, 0);
+	err = campaign_zone_node_add(zone, addr);
+	if (err) {
+		shell_print(monitor_shell, "Could not add node %d to zone %d (err %d)\n", addr,
+			    zone, err);
+	}
+
+	return 0;
+}
+
+static int cmd_campaign(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint16_t msg_duration;
 	uint32_t msg_value;
+	uint16_t max_concurrent;
 
-	msg_value = strtol(argv[1], NULL, 0);
-	active_nodes.nodes[active_nodes.len] = msg_value;
+	msg_duration = strtol(argv[1], NULL, 0);
+	msg_value = strtol(argv[2], NULL, 0);
+	max_concurrent = strtol(argv[3], NULL, 0);
+
+	if (test_running) {
+		shell_print(monitor_shell, "Test is already running \n");
+		return 0;
+	}
+
+	gateway_time_set(msg_value);
+	err = campaign_start(msg_duration, max_concurrent);
+	if (err) {
+		shell_print(monitor_shell, "Could not start campaign (err %d)\n", err);
+	}
 
 	return 0;
 }
 
-static int cmd_add_node(const struct shell *shell, size_t argc, char *argv[])
+static int cmd_schedule(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint16_t addr;
+	struct test_schedule schedule;
+
+	addr = strtol(argv[1], NULL, 0);
+	schedule.fn_period = strtol(argv[2], NULL, 0);
+	schedule.fn_duration = strtol(argv[3], NULL, 0);
+	schedule.full_period = strtol(argv[4], NULL, 0);
+	schedule.full_duration = strtol(argv[5], NULL, 0);
+	schedule.offset = strtol(argv[6], NULL, 0);
+	set_test_schedule(&monitor, addr, &schedule);
+
+	return 0;
+}
+
+static int cmd_time(const struct shell *shell, size_t argc, char *argv[])
 {
 	uint32_t msg_value;
 
 	msg_value = strtol(argv[1], NULL, 0);
-	active_nodes.len++;
-	active_nodes.nodes[active_nodes.len] = msg_value;
+	err = gateway_time_set(msg_value);
+	if (err) {
+		shell_print(monitor_shell, "Could not publish time (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_time_get(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.app_idx = time_cli.model->keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+
+	ctx.addr = strtol(argv[1], NULL, 0);
+	bt_mesh_time_cli_time_get(&time_cli, &ctx, NULL);
+
+	return 0;
+}
+
+/* The node publishes its reading right away when it moves by more than the
+ * delta, and at its configured publish period otherwise.
+ */
+static int cmd_sensor_cadence(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct bt_mesh_msg_ctx ctx = {
+		.app_idx = monitor.sensor_cli.model->keys[0],
+		.send_ttl = BT_MESH_TTL_DEFAULT,
+	};
+	struct bt_mesh_sensor_cadence_status cadence = {
+		.threshold = {
+			.delta = {
+				.type = BT_MESH_SENSOR_DELTA_VALUE,
+			},
+			.cadence = BT_MESH_SENSOR_CADENCE_NORMAL,
+		},
+	};
+
+	ctx.addr = strtol(argv[1], NULL, 0);
+	cadence.threshold.delta.up.val1 = strtol(argv[2], NULL, 0);
+	cadence.threshold.delta.down.val1 = cadence.threshold.delta.up.val1;
+	cadence.min_int = strtol(argv[3], NULL, 0);
+
+	err = bt_mesh_sensor_cli_cadence_set(&monitor.sensor_cli, &ctx,
+					     &bt_mesh_sensor_present_amb_light_level, &cadence,
+					     NULL);
+	if (err) {
+		shell_print(monitor_shell, "Could not set sensor cadence (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_topology(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = relay_prune_survey();
+	if (err) {
+		shell_print(monitor_shell, "Could not survey the topology (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_relay_prune(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = relay_prune_start();
+	if (err) {
+		shell_print(monitor_shell, "Could not prune relays (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_relay_restore(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = relay_prune_restore();
+	if (err) {
+		shell_print(monitor_shell, "Could not restore relays (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_tx_tune(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = relay_prune_tune();
+	if (err) {
+		shell_print(monitor_shell, "Could not tune the retransmissions (err %d)\n", err);
+	}
+
 	return 0;
 }
 
+static int cmd_links(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = link_stats_print();
+	if (err) {
+		shell_print(monitor_shell, "Could not print the link statistics (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_replay(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint32_t seq = strtoul(argv[1], NULL, 0);
+
+	err = result_ring_replay(seq);
+	if (err) {
+		shell_print(monitor_shell, "Could not replay the stored results (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_workq(const struct shell *shell, size_t argc, char *argv[])
+{
+	struct light_monitor_workq_stats stats;
+
+	for (int i = 0; i < LIGHT_MONITOR_WORKQ_COUNT; i++) {
+		err = light_monitor_workq_stats_get(i, &stats);
+		if (err) {
+			shell_print(monitor_shell, "Could not get the work queue stats (err %d)\n", err);
+			return 0;
+		}
+
+		shell_print(monitor_shell, "workq %s %u %u %u %zu %zu", stats.name, stats.latency_us,
+			    stats.latency_max_us, stats.probes, stats.stack_unused, stats.stack_size);
+	}
+
+	return 0;
+}
 
 static int cmd_calibrate_node(const struct shell *shell, size_t argc, char *argv[])
 {
 	uint32_t msg_value;
 
 	msg_value = strtol(argv[1], NULL, 0);
-	calibrate_node(&monitor, msg_value);
+	err = calibration_node(msg_value);
+	if (err) {
+		shell_print(monitor_shell, "Could not calibrate the node (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_calibrate_all(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = calibration_start();
+	if (err) {
+		shell_print(monitor_shell, "Could not start the calibration (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_prov_create(const struct shell *shell, size_t argc, char *argv[])
+{
+	err = provisioner_create();
+	if (err) {
+		shell_print(monitor_shell, "Could not create the network (err %d)\n", err);
+	}
+
+	return 0;
+}
+
+static int cmd_prov_scan(const struct shell *shell, size_t argc, char *argv[])
+{
+	uint16_t seconds = strtoul(argv[1], NULL, 0);
+
+	err = provisioner_scan(seconds);
+	if (err) {
+		shell_print(monitor_shell, "Could not start the commissioning (err %d)\n", err);
+	}
 
 	return 0;
 }
 
 SHELL_STATIC_SUBCMD_SET_CREATE(monitor_cmds,
 	SHELL_CMD_ARG(start, NULL, "Start test", cmd_test_start, 3, 0),
-	SHELL_CMD_ARG(status, NULL, "Get status", cmd_get_status, 0, 0),
+	SHELL_CMD_ARG(status, NULL,
+		      "Get status. Input is the optional max age (s) of the cached statuses",
+		      cmd_get_status, 1, 1),
 	SHELL_CMD_ARG(log, NULL, "get log", cmd_get_result_log, 2, 0),
 	SHELL_CMD_ARG(ack, NULL, "get ack from selected node. Input is node addr", cmd_get_test_ack, 2, 0),
 	SHELL_CMD_ARG(nodeslist, NULL, "Get a list of the nodes registered on the card", cmd_nodes_list, 0, 0),
@@ -441,6 +960,52 @@ SHELL_STATIC_SUBCMD_SET_CREATE(monitor_cmds,
 	SHELL_CMD_ARG(add_first_node, NULL, "Add the first node to a blank list", cmd_add_first_node, 2, 0),
 	SHELL_CMD_ARG(add_node, NULL, "Add a node to a not empty list", cmd_add_node, 2, 0),
 	SHELL_CMD_ARG(calibrate, NULL, "Calibrate the sensor on the node", cmd_calibrate_node, 2, 0),
+	SHELL_CMD_ARG(calibrate_all, NULL, "Calibrate the sensor on every node of the list",
+		      cmd_calibrate_all, 0, 0),
+	SHELL_CMD_ARG(schedule, NULL,
+		      "Set the autonomous test schedule of a node. Input is node addr, functional "
+		      "period (days) and duration (s), full test period (days) and duration (min) "
+		      "and offset (min)",
+		      cmd_schedule, 7, 0),
+	SHELL_CMD_ARG(time, NULL, "Set and publish the network time. Input is Unix time", cmd_time,
+		      2, 0),
+	SHELL_CMD_ARG(time_get, NULL, "Get the time of a node. Input is node addr", cmd_time_get,
+		      2, 0),
+	SHELL_CMD_ARG(zone_reset, NULL, "Remove all campaign zones", cmd_zone_reset, 0, 0),
+	SHELL_CMD_ARG(zone, NULL, "Define a zone. Input is zone index and group addr", cmd_zone, 3, 0),
+	SHELL_CMD_ARG(zone_node, NULL, "Add a node to a zone. Input is zone index and node addr",
+		      cmd_zone_node, 3, 0),
+	SHELL_CMD_ARG(campaign, NULL,
+		      "Start a test in waves. Input is duration, timestamp and max concurrent nodes",
+		      cmd_campaign, 4, 0),
+	SHELL_CMD_ARG(sensor_cadence, NULL,
+		      "Set the sensor cadence of a node. Input is node addr, delta (lux) and "
+		      "minimum interval (log2 ms)",
+		      cmd_sensor_cadence, 4, 0),
+	SHELL_CMD_ARG(topology, NULL, "Survey the hop count of every node", cmd_topology, 0, 0),
+	SHELL_CMD_ARG(relay_prune, NULL, "Disable the relays that aren't needed", cmd_relay_prune,
+		      0, 0),
+	SHELL_CMD_ARG(relay_restore, NULL, "Restore the relays changed by relay_prune",
+		      cmd_relay_restore, 0, 0),
+	SHELL_CMD_ARG(tx_tune, NULL,
+		      "Size the retransmissions of every node from the roster and its hop count",
+		      cmd_tx_tune, 0, 0),
+	SHELL_CMD_ARG(replay, NULL,
+		      "Print the results stored after a sequence number. Input is the last "
+		      "sequence number the host has",
+		      cmd_replay, 2, 0),
+	SHELL_CMD_ARG(cache, NULL, "Print what the gateway knows of a node. Input is node addr",
+		      cmd_cache, 2, 0),
+	SHELL_CMD_ARG(links, NULL, "Print the link statistics of every node", cmd_links, 0, 0),
+	SHELL_CMD_ARG(workq, NULL,
+		      "Print the latency (us) and unused stack (bytes) of the work queues", cmd_workq,
+		      0, 0),
+	SHELL_CMD_ARG(prov_create, NULL, "Create a new network with the gateway as first node",
+		      cmd_prov_create, 0, 0),
+	SHELL_CMD_ARG(prov_scan, NULL,
+		      "Provision and configure the unprovisioned nodes. Input is how long to "
+		      "accept new nodes (s)",
+		      cmd_prov_scan, 2, 0),
 	SHELL_SUBCMD_SET_END
 );
 
@@ -468,7 +1033,23 @@ const struct bt_mesh_comp *model_handler_init(void)
 	k_work_init_delayable(&sched_res_work, sched_res_work_cb);
 
 	monitor_shell = shell_backend_uart_get_ptr();
+	time_srv.data.role = BT_MESH_TIME_AUTHORITY;
+	k_work_queue_start(&cfg_cli_wq, cfg_cli_stack, K_THREAD_STACK_SIZEOF(cfg_cli_stack),
+			   CFG_CLI_PRIORITY, NULL);
 	shell_print(monitor_shell, ">>> Shell test <<<");
+	campaign_init(&monitor, monitor_shell);
+	calibration_init(&monitor, monitor_shell);
+	relay_prune_init(&elements[0], monitor_shell);
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROVISIONER
+	provisioner_init(monitor_shell);
+#endif
+	sweep_summary_init(monitor_shell);
+	node_cache_init(&monitor, monitor_shell);
+	link_stats_init(monitor_shell);
+	err = result_ring_init(monitor_shell);
+	if (err) {
+		shell_print(monitor_shell, "Result ring unavailable (err %d)\n", err);
+	}
 	/* uart_init(); */
 	static struct button_handler button_handler = {
 		.cb = button_handler_cb,
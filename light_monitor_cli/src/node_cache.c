@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include "model_handler.h"
+#include "node_cache.h"
+#include "light_monitor_workq.h"
+
+/* Pace of the unicast refreshes, so the answers don't all collide */
+#define REFRESH_INTERVAL K_MSEC(100)
+#define RESULT_NONE 0xff
+#define REFRESH_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
+
+struct node_cache_entry {
+	/* Uptime in seconds of the last message, 0 if none */
+	uint32_t seen;
+	/* Uptime in seconds of the last status, 0 if none */
+	uint32_t status_at;
+	/* Unix time of the last log entry */
+	uint32_t log_time;
+	uint16_t status;
+	uint8_t result;
+};
+
+/* By roster index, cleared when the index is given to another node */
+static struct node_cache_entry cache[ROSTER_SIZE];
+static ATOMIC_DEFINE(stale, ROSTER_SIZE);
+static struct bt_mesh_light_monitor *cache_monitor;
+static const struct shell *cache_shell;
+static int refresh_idx;
+
+static uint32_t uptime_s(void)
+{
+	/* Offset by one so 0 means never */
+	return k_uptime_get() / MSEC_PER_SEC + 1;
+}
+
+static struct node_cache_entry *entry_get(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+	struct node_cache_entry *entry;
+
+	if (idx < 0) {
+		return NULL;
+	}
+
+	entry = &cache[idx];
+	entry->seen = uptime_s();
+
+	return entry;
+}
+
+void node_cache_clear(int idx)
+{
+	memset(&cache[idx], 0, sizeof(cache[idx]));
+	cache[idx].result = RESULT_NONE;
+	atomic_clear_bit(stale, idx);
+}
+
+void node_cache_seen(uint16_t addr)
+{
+	(void)entry_get(addr);
+}
+
+void node_cache_status(uint16_t addr, uint16_t value)
+{
+	struct node_cache_entry *entry = entry_get(addr);
+
+	if (!entry) {
+		return;
+	}
+
+	entry->status = value;
+	entry->status_at = entry->seen;
+	/* Answered, whether or not it was asked */
+	atomic_clear_bit(stale, entry - cache);
+}
+
+void node_cache_result(uint16_t addr, bool passed)
+{
+	struct node_cache_entry *entry = entry_get(addr);
+
+	if (entry) {
+		entry->result = passed;
+	}
+}
+
+void node_cache_log(uint16_t addr, uint32_t time_stamp)
+{
+	struct node_cache_entry *entry = entry_get(addr);
+
+	if (entry) {
+		entry->log_time = MAX(entry->log_time, time_stamp);
+	}
+}
+
+static void refresh_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(refresh_work, refresh_work_handler);
+
+static void refresh_work_handler(struct k_work *work)
+{
+	/* One stale node per run */
+	for (; refresh_idx < active_nodes.len; refresh_idx++) {
+		uint16_t addr = active_nodes.nodes[refresh_idx];
+		int err;
+
+		if (!atomic_test_and_clear_bit(stale, refresh_idx)) {
+			continue;
+		}
+
+		refresh_idx++;
+		err = get_status_single(cache_monitor, addr);
+		if (err) {
+			shell_print(cache_shell, "Could not refresh the status of node %d (err %d)",
+				    addr, err);
+		}
+
+		k_work_reschedule_for_queue(REFRESH_WQ, &refresh_work, REFRESH_INTERVAL);
+		return;
+	}
+}
+
+int node_cache_query(uint32_t max_age_s)
+{
+	uint32_t now = uptime_s();
+	int stale_cnt = 0;
+
+	if (active_nodes.len == 0) {
+		/* No roster, nothing to answer from */
+		return get_status(cache_monitor);
+	}
+
+	for (int i = 0; i < active_nodes.len; i++) {
+		struct node_cache_entry *entry = &cache[i];
+
+		if (entry->status_at && now - entry->status_at <= max_age_s) {
+			shell_print(cache_shell, "status %d %d", active_nodes.nodes[i], entry->status);
+			continue;
+		}
+
+		atomic_set_bit(stale, i);
+		stale_cnt++;
+	}
+
+	if (!stale_cnt) {
+		return 0;
+	}
+
+	/* Past half the roster, one group message costs less than the unicasts */
+	if (stale_cnt * 2 > active_nodes.len) {
+		k_work_cancel_delayable(&refresh_work);
+		roster_bitmap_clear(stale);
+
+		return get_status(cache_monitor);
+	}
+
+	refresh_idx = 0;
+	k_work_reschedule_for_queue(REFRESH_WQ, &refresh_work, K_NO_WAIT);
+
+	return 0;
+}
+
+int node_cache_print(uint16_t addr)
+{
+	int idx = active_nodes_find(addr);
+	struct node_cache_entry *entry;
+
+	if (idx < 0) {
+		return -ENOENT;
+	}
+
+	entry = &cache[idx];
+	if (!entry->seen) {
+		shell_print(cache_shell, "cache %d - - - -", addr);
+		return 0;
+	}
+
+	shell_print(cache_shell, "cache %d %u %d %d %u", addr, uptime_s() - entry->seen,
+		    entry->status_at ? entry->status : -1,
+		    entry->result == RESULT_NONE ? -1 : entry->result, entry->log_time);
+
+	return 0;
+}
+
+void node_cache_init(struct bt_mesh_light_monitor *monitor, const struct shell *sh)
+{
+	cache_monitor = monitor;
+	cache_shell = sh;
+}
@@ -0,0 +1,564 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/crypto.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <zephyr/random/rand32.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#include <bluetooth/mesh/models.h>
+#include "light_monitor_cli.h"
+#include "light_monitor_workq.h"
+#include "model_handler.h"
+#include "campaign.h"
+#include "provisioner.h"
+
+#define GATEWAY_ADDR CONFIG_BT_MESH_LIGHT_MONITOR_GATEWAY_ADDR
+#define NODES_GROUP CONFIG_BT_MESH_LIGHT_MONITOR_NODES_GROUP
+#define GATEWAY_GROUP CONFIG_BT_MESH_LIGHT_MONITOR_GATEWAY_GROUP
+#define PROV_QUEUE_LEN CONFIG_BT_MESH_LIGHT_MONITOR_PROV_QUEUE
+#define APP_IDX 0
+/* Links are opened and closed from the reply queue while the provisioned
+ * nodes are configured from the Configuration Client queue, so the next node
+ * is provisioned while the last one is configured.
+ */
+#define PROV_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
+
+/* The nodes publish their light reading at least this often */
+#define SENSOR_PUB_PERIOD BT_MESH_PUB_PERIOD_10MIN(1)
+
+#define UUID_LEN 16
+#define UUID_STR_LEN (UUID_LEN * 2 + 1)
+#define STATIC_OOB_LEN 16
+
+struct model_cfg {
+	uint16_t id;
+	/* Company ID of a vendor model, BT_MESH_CID_NVAL for a SIG model */
+	uint16_t cid;
+	/* Group the model subscribes to, if any */
+	uint16_t sub;
+	/* Publish address, if any */
+	uint16_t pub;
+	uint8_t period;
+};
+
+static const struct model_cfg node_models[] = {
+	{ BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID, NODES_GROUP,
+	  GATEWAY_GROUP },
+	{ BT_MESH_LIGHT_MONITOR_SRV_SETUP_MODEL_ID, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID,
+	  NODES_GROUP },
+	{ BT_MESH_MODEL_ID_SENSOR_SRV, BT_MESH_CID_NVAL, 0, GATEWAY_GROUP, SENSOR_PUB_PERIOD },
+	{ BT_MESH_MODEL_ID_SENSOR_SETUP_SRV, BT_MESH_CID_NVAL },
+	{ BT_MESH_MODEL_ID_TIME_SRV, BT_MESH_CID_NVAL, NODES_GROUP },
+	{ BT_MESH_MODEL_ID_TIME_SETUP_SRV, BT_MESH_CID_NVAL },
+};
+
+static const struct model_cfg gateway_models[] = {
+	{ BT_MESH_LIGHT_MONITOR_VENDOR_MODEL_ID, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID,
+	  GATEWAY_GROUP, NODES_GROUP },
+	{ BT_MESH_MODEL_ID_SENSOR_CLI, BT_MESH_CID_NVAL, GATEWAY_GROUP },
+	{ BT_MESH_MODEL_ID_TIME_SRV, BT_MESH_CID_NVAL, 0, NODES_GROUP },
+	{ BT_MESH_MODEL_ID_TIME_SETUP_SRV, BT_MESH_CID_NVAL },
+	{ BT_MESH_MODEL_ID_TIME_CLI, BT_MESH_CID_NVAL },
+};
+
+static struct {
+	const struct shell *shell;
+	/* Devices heard during the scan, waiting for the link */
+	uint8_t queue[PROV_QUEUE_LEN][UUID_LEN];
+	uint8_t queued;
+	uint8_t link_uuid[UUID_LEN];
+	bool link_busy;
+	bool link_added;
+	bool scanning;
+	/* Set from the scan until the run is reported as done */
+	bool running;
+	/* Last node the configuration was tried on */
+	uint16_t config_addr;
+	atomic_t provisioned;
+	atomic_t configured;
+	atomic_t prov_failed;
+	atomic_t config_failed;
+	/* Zone each roster node is subscribed to, CAMPAIGN_NO_ZONE if unknown */
+	uint8_t zone_sub[ROSTER_SIZE];
+} prov;
+
+static uint8_t dev_uuid[UUID_LEN];
+
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROV_AUTH_STATIC
+BUILD_ASSERT(sizeof(CONFIG_BT_MESH_LIGHT_MONITOR_PROV_STATIC_OOB) == STATIC_OOB_LEN * 2 + 1,
+	     "The static OOB value must be 32 hex digits");
+
+static uint8_t static_oob[STATIC_OOB_LEN];
+#endif
+
+/* Beacons of the unprovisioned devices, passed on from the mesh stack */
+K_MSGQ_DEFINE(beacon_msgq, UUID_LEN, PROV_QUEUE_LEN, 1);
+
+static struct k_work prov_work;
+static struct k_work link_closed_work;
+static struct k_work_delayable scan_end_work;
+static struct k_work config_work;
+static struct k_work zone_work;
+
+static const char *uuid_str(const uint8_t uuid[UUID_LEN], char str[UUID_STR_LEN])
+{
+	if (!bin2hex(uuid, UUID_LEN, str, UUID_STR_LEN)) {
+		str[0] = '\0';
+	}
+
+	return str;
+}
+
+static bool uuid_known(const uint8_t uuid[UUID_LEN])
+{
+	if (prov.link_busy && !memcmp(uuid, prov.link_uuid, UUID_LEN)) {
+		return true;
+	}
+
+	for (int i = 0; i < prov.queued; i++) {
+		if (!memcmp(uuid, prov.queue[i], UUID_LEN)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* The run is done once the scan is closed and every node it provisioned has
+ * been configured, or has failed.
+ */
+static void commission_done_check(void)
+{
+	int provisioned = atomic_get(&prov.provisioned);
+	int configured = atomic_get(&prov.configured);
+	int config_failed = atomic_get(&prov.config_failed);
+
+	if (!prov.running || prov.scanning || prov.link_busy || prov.queued ||
+	    configured + config_failed < provisioned) {
+		return;
+	}
+
+	prov.running = false;
+	shell_print(prov.shell, "commission done %d %d %d", provisioned, configured,
+		    config_failed + (int)atomic_get(&prov.prov_failed));
+}
+
+static void prov_work_handler(struct k_work *work)
+{
+	char str[UUID_STR_LEN];
+	uint8_t uuid[UUID_LEN];
+	int err;
+
+	/* A device beacons until it is provisioned, it is queued once */
+	while (!k_msgq_get(&beacon_msgq, uuid, K_NO_WAIT)) {
+		if (prov.scanning && prov.queued < PROV_QUEUE_LEN && !uuid_known(uuid)) {
+			memcpy(prov.queue[prov.queued++], uuid, UUID_LEN);
+		}
+	}
+
+	while (!prov.link_busy && prov.queued) {
+		memcpy(prov.link_uuid, prov.queue[0], UUID_LEN);
+		memmove(prov.queue[0], prov.queue[1], --prov.queued * UUID_LEN);
+
+		/* The node gets the lowest free unicast address */
+		err = bt_mesh_provision_adv(prov.link_uuid, BT_MESH_NET_PRIMARY,
+					    BT_MESH_ADDR_UNASSIGNED, 0);
+		if (err) {
+			atomic_inc(&prov.prov_failed);
+			shell_print(prov.shell, "provision failed %s",
+				    uuid_str(prov.link_uuid, str));
+			continue;
+		}
+
+		prov.link_busy = true;
+		prov.link_added = false;
+		shell_print(prov.shell, "provisioning %s", uuid_str(prov.link_uuid, str));
+	}
+
+	commission_done_check();
+}
+
+static void link_closed_work_handler(struct k_work *work)
+{
+	char str[UUID_STR_LEN];
+
+	/* Links of the gateway itself being provisioned aren't ours */
+	if (!prov.link_busy) {
+		return;
+	}
+
+	if (!prov.link_added) {
+		atomic_inc(&prov.prov_failed);
+		shell_print(prov.shell, "provision failed %s", uuid_str(prov.link_uuid, str));
+	}
+
+	prov.link_busy = false;
+	prov_work_handler(&prov_work);
+}
+
+static void scan_end_work_handler(struct k_work *work)
+{
+	prov.scanning = false;
+	prov_work_handler(&prov_work);
+}
+
+static void unprovisioned_beacon(uint8_t uuid[16], bt_mesh_prov_oob_info_t oob_info,
+				 uint32_t *uri_hash)
+{
+	if (!prov.scanning) {
+		return;
+	}
+
+	/* Repeated beacons are dropped once the queue is full */
+	if (!k_msgq_put(&beacon_msgq, uuid, K_NO_WAIT)) {
+		(void)k_work_submit_to_queue(PROV_WQ, &prov_work);
+	}
+}
+
+static void node_added(uint16_t net_idx, uint8_t uuid[16], uint16_t addr, uint8_t num_elem)
+{
+	char str[UUID_STR_LEN];
+
+	prov.link_added = true;
+	atomic_inc(&prov.provisioned);
+	shell_print(prov.shell, "provisioned %d %s", addr, uuid_str(uuid, str));
+	(void)k_work_submit_to_queue(cfg_cli_workq(), &config_work);
+}
+
+static void link_close(bt_mesh_prov_bearer_t bearer)
+{
+	(void)k_work_submit_to_queue(PROV_WQ, &link_closed_work);
+}
+
+/* The nodes are installed by whoever runs the commissioning, there is nobody
+ * at the node to enter or read back a number. They are either authenticated
+ * with the static OOB value they share with the gateway, or not at all.
+ */
+static void capabilities(const struct bt_mesh_dev_capabilities *cap)
+{
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROV_AUTH_STATIC
+	/* A node without the static value fails the provisioning */
+	(void)bt_mesh_auth_method_set_static(static_oob, sizeof(static_oob));
+#else
+	(void)bt_mesh_auth_method_set_none();
+#endif
+}
+
+static const struct bt_mesh_prov prov_params = {
+	.uuid = dev_uuid,
+	.unprovisioned_beacon = unprovisioned_beacon,
+	.node_added = node_added,
+	.link_close = link_close,
+	.capabilities = capabilities,
+};
+
+static int model_configure(uint16_t addr, const uint8_t app_key[16],
+			   const struct model_cfg *models, size_t count)
+{
+	struct bt_mesh_cfg_cli_mod_pub pub = {
+		.app_idx = APP_IDX,
+		.ttl = BT_MESH_TTL_DEFAULT,
+	};
+	uint8_t status;
+	int err;
+
+	err = bt_mesh_cfg_cli_app_key_add(BT_MESH_NET_PRIMARY, addr, BT_MESH_NET_PRIMARY, APP_IDX,
+					  app_key, &status);
+	if (err || status) {
+		return err ? err : -EIO;
+	}
+
+	for (int i = 0; i < count; i++) {
+		const struct model_cfg *cfg = &models[i];
+		bool vnd = cfg->cid != BT_MESH_CID_NVAL;
+
+		err = vnd ? bt_mesh_cfg_cli_mod_app_bind_vnd(BT_MESH_NET_PRIMARY, addr, addr,
+							     APP_IDX, cfg->id, cfg->cid, &status) :
+			    bt_mesh_cfg_cli_mod_app_bind(BT_MESH_NET_PRIMARY, addr, addr, APP_IDX,
+							 cfg->id, &status);
+		if (err || status) {
+			return err ? err : -EIO;
+		}
+
+		if (cfg->sub) {
+			err = vnd ? bt_mesh_cfg_cli_mod_sub_add_vnd(BT_MESH_NET_PRIMARY, addr, addr,
+								    cfg->sub, cfg->id, cfg->cid,
+								    &status) :
+				    bt_mesh_cfg_cli_mod_sub_add(BT_MESH_NET_PRIMARY, addr, addr,
+								cfg->sub, cfg->id, &status);
+			if (err || status) {
+				return err ? err : -EIO;
+			}
+		}
+
+		if (cfg->pub) {
+			pub.addr = cfg->pub;
+			pub.period = cfg->period;
+			err = vnd ? bt_mesh_cfg_cli_mod_pub_set_vnd(BT_MESH_NET_PRIMARY, addr, addr,
+								    cfg->id, cfg->cid, &pub,
+								    &status) :
+				    bt_mesh_cfg_cli_mod_pub_set(BT_MESH_NET_PRIMARY, addr, addr,
+								cfg->id, &pub, &status);
+			if (err || status) {
+				return err ? err : -EIO;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* The subscriptions of the server are replaced by the node group and the zone
+ * group, so whatever zone the node was in before, even one the gateway has
+ * forgotten since, is left.
+ */
+static int zone_subscribe(uint16_t addr, uint16_t group)
+{
+	uint8_t status;
+	int err;
+
+	err = bt_mesh_cfg_cli_mod_sub_overwrite_vnd(BT_MESH_NET_PRIMARY, addr, addr, NODES_GROUP,
+						    BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID,
+						    BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID,
+						    &status);
+	if (err || status) {
+		return err ? err : -EIO;
+	}
+
+	err = bt_mesh_cfg_cli_mod_sub_add_vnd(BT_MESH_NET_PRIMARY, addr, addr, group,
+					      BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID,
+					      BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID, &status);
+	if (err || status) {
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+/* Nodes without a zone keep their subscriptions, so the zones being assigned
+ * again before a campaign don't move every node out and back in.
+ */
+static int zone_configure(int idx)
+{
+	uint16_t addr = active_nodes.nodes[idx];
+	uint8_t zone = campaign_node_zone(addr);
+	uint16_t group = campaign_zone_group(zone);
+	int err;
+
+	if (addr == 0 || zone == CAMPAIGN_NO_ZONE || zone == prov.zone_sub[idx] ||
+	    group == BT_MESH_ADDR_UNASSIGNED) {
+		return 0;
+	}
+
+	err = zone_subscribe(addr, group);
+	if (err) {
+		shell_print(prov.shell, "zone subscribe failed %d %d", addr, err);
+		return err;
+	}
+
+	prov.zone_sub[idx] = zone;
+	shell_print(prov.shell, "zone subscribed %d %d", addr, group);
+	return 0;
+}
+
+static void zone_work_handler(struct k_work *work)
+{
+	for (int i = 0; i < active_nodes.len; i++) {
+		(void)zone_configure(i);
+	}
+}
+
+static uint8_t next_node_find(struct bt_mesh_cdb_node *node, void *user_data)
+{
+	struct bt_mesh_cdb_node **next = user_data;
+
+	if (!atomic_test_bit(node->flags, BT_MESH_CDB_NODE_CONFIGURED) &&
+	    node->addr > prov.config_addr && (!*next || node->addr < (*next)->addr)) {
+		*next = node;
+	}
+
+	return BT_MESH_CDB_ITER_CONTINUE;
+}
+
+/* Configure the provisioned nodes in address order. A node that fails is left
+ * unconfigured in the database, and is tried again by the next scan.
+ */
+static void config_work_handler(struct k_work *work)
+{
+	struct bt_mesh_cdb_app_key *key;
+	uint8_t app_key[16];
+	int idx;
+	int err;
+
+	key = bt_mesh_cdb_app_key_get(APP_IDX);
+	if (!key || bt_mesh_cdb_app_key_export(key, 0, app_key)) {
+		return;
+	}
+
+	while (true) {
+		struct bt_mesh_cdb_node *node = NULL;
+
+		bt_mesh_cdb_node_foreach(next_node_find, &node);
+		if (!node) {
+			break;
+		}
+
+		prov.config_addr = node->addr;
+
+		if (node->addr == GATEWAY_ADDR) {
+			err = model_configure(node->addr, app_key, gateway_models,
+					      ARRAY_SIZE(gateway_models));
+		} else {
+			err = model_configure(node->addr, app_key, node_models,
+					      ARRAY_SIZE(node_models));
+
+			/* A node already in a zone joins its group right away */
+			idx = active_nodes_find(node->addr);
+			if (!err && idx >= 0) {
+				prov.zone_sub[idx] = CAMPAIGN_NO_ZONE;
+				err = zone_configure(idx);
+			}
+		}
+
+		if (err) {
+			atomic_inc(&prov.config_failed);
+			shell_print(prov.shell, "configure failed %d %d", node->addr, err);
+			continue;
+		}
+
+		atomic_set_bit(node->flags, BT_MESH_CDB_NODE_CONFIGURED);
+		if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+			bt_mesh_cdb_node_store(node);
+		}
+
+		if (node->addr == GATEWAY_ADDR) {
+			shell_print(prov.shell, "gateway configured");
+		} else {
+			atomic_inc(&prov.configured);
+			shell_print(prov.shell, "configured %d", node->addr);
+		}
+	}
+
+	(void)k_work_submit_to_queue(PROV_WQ, &prov_work);
+}
+
+void provisioner_zones_sync(void)
+{
+	(void)k_work_submit_to_queue(cfg_cli_workq(), &zone_work);
+}
+
+void provisioner_zone_clear(int idx)
+{
+	prov.zone_sub[idx] = CAMPAIGN_NO_ZONE;
+}
+
+const struct bt_mesh_prov *provisioner_prov_init(void)
+{
+	if (hwinfo_get_device_id(dev_uuid, sizeof(dev_uuid)) < 0) {
+		sys_rand_get(dev_uuid, sizeof(dev_uuid));
+	}
+
+	return &prov_params;
+}
+
+void provisioner_init(const struct shell *sh)
+{
+	prov.shell = sh;
+
+	k_work_init(&prov_work, prov_work_handler);
+	k_work_init(&link_closed_work, link_closed_work_handler);
+	k_work_init_delayable(&scan_end_work, scan_end_work_handler);
+	k_work_init(&config_work, config_work_handler);
+	k_work_init(&zone_work, zone_work_handler);
+	memset(prov.zone_sub, CAMPAIGN_NO_ZONE, sizeof(prov.zone_sub));
+}
+
+int provisioner_create(void)
+{
+	struct bt_mesh_cdb_app_key *key;
+	uint8_t net_key[16];
+	uint8_t app_key[16];
+	uint8_t dev_key[16];
+	int err;
+
+	if (bt_mesh_is_provisioned()) {
+		return -EALREADY;
+	}
+
+	err = bt_rand(net_key, sizeof(net_key));
+	err = err ? err : bt_rand(app_key, sizeof(app_key));
+	err = err ? err : bt_rand(dev_key, sizeof(dev_key));
+	if (err) {
+		return err;
+	}
+
+	err = bt_mesh_cdb_create(net_key);
+	if (err) {
+		return err;
+	}
+
+	key = bt_mesh_cdb_app_key_alloc(BT_MESH_NET_PRIMARY, APP_IDX);
+	if (!key) {
+		return -ENOMEM;
+	}
+
+	err = bt_mesh_cdb_app_key_import(key, 0, app_key);
+	if (err) {
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+		bt_mesh_cdb_app_key_store(key);
+	}
+
+	err = bt_mesh_provision(net_key, BT_MESH_NET_PRIMARY, 0, 0, GATEWAY_ADDR, dev_key);
+	if (err) {
+		return err;
+	}
+
+	prov.config_addr = BT_MESH_ADDR_UNASSIGNED;
+	(void)k_work_submit_to_queue(cfg_cli_workq(), &config_work);
+
+	return 0;
+}
+
+int provisioner_scan(uint16_t seconds)
+{
+	if (!atomic_test_bit(bt_mesh_cdb.flags, BT_MESH_CDB_VALID)) {
+		return -ENOENT;
+	}
+
+	if (prov.running) {
+		return -EBUSY;
+	}
+
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_PROV_AUTH_STATIC
+	/* No node is let in without a valid value to authenticate it with */
+	if (hex2bin(CONFIG_BT_MESH_LIGHT_MONITOR_PROV_STATIC_OOB,
+		    strlen(CONFIG_BT_MESH_LIGHT_MONITOR_PROV_STATIC_OOB), static_oob,
+		    sizeof(static_oob)) != sizeof(static_oob)) {
+		return -EINVAL;
+	}
+#endif
+
+	atomic_clear(&prov.provisioned);
+	atomic_clear(&prov.configured);
+	atomic_clear(&prov.prov_failed);
+	atomic_clear(&prov.config_failed);
+	prov.running = true;
+	prov.scanning = true;
+
+	/* The nodes that failed their configuration last time are tried again */
+	prov.config_addr = BT_MESH_ADDR_UNASSIGNED;
+	(void)k_work_submit_to_queue(cfg_cli_workq(), &config_work);
+	k_work_reschedule_for_queue(PROV_WQ, &scan_end_work, K_SECONDS(seconds));
+
+	return 0;
+}
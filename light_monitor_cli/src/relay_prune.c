@@ -0,0 +1,510 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/mesh.h>
+#include <zephyr/shell/shell.h>
+#include "light_monitor_cli.h"
+#include "model_handler.h"
+#include "campaign.h"
+#include "link_stats.h"
+#include "relay_prune.h"
+
+/* Heartbeat subscription period of the gateway, log encoded: 2^(5-1) s */
+#define HB_SUB_PERIOD_LOG 5
+/* Every surveyed node sends a single heartbeat, log encoded */
+#define HB_PUB_COUNT_LOG 1
+#define HB_PUB_PERIOD_LOG 1
+#define HB_TIMEOUT K_SECONDS(4)
+/* Time given to the network to settle before reachability is checked */
+#define RELAY_SETTLE_TIME K_SECONDS(10)
+
+#define HOPS_UNKNOWN LINK_STATS_HOPS_UNKNOWN
+#define RELAY_UNCHANGED 0xFF
+/* Bucket of the nodes that aren't assigned to a zone */
+#define ZONE_NONE_IDX CONFIG_BT_MESH_LIGHT_MONITOR_MAX_ZONES
+
+/* Roster sizes above which every node sends fewer copies of its messages, as
+ * their collisions start to cost more than they recover.
+ */
+#define TUNE_SMALL_SITE 64
+#define TUNE_LARGE_SITE 512
+#define TUNE_NET_RETX_MAX 3
+#define TUNE_PUB_RETX_MAX 2
+/* Pause between two settings pushed without waiting for the answer */
+#define TUNE_PACE K_MSEC(50)
+#define TUNE_SETTLE_TIME K_SECONDS(5)
+
+struct tx_plan {
+	uint8_t net;
+	uint8_t relay;
+	uint8_t pub;
+};
+
+static struct {
+	const struct shell *shell;
+	const struct bt_mesh_elem *elem;
+	uint8_t hops[ARRAY_SIZE(active_nodes.nodes)];
+	ATOMIC_DEFINE(keep, ROSTER_SIZE);
+	/* Relay state before pruning, RELAY_UNCHANGED if it wasn't changed */
+	uint8_t relay_prev[ARRAY_SIZE(active_nodes.nodes)];
+	uint8_t transmit_prev[ARRAY_SIZE(active_nodes.nodes)];
+	uint16_t hb_src;
+	uint8_t hb_hops;
+	bool busy;
+} prune;
+
+static K_SEM_DEFINE(hb_sem, 0, 1);
+static struct k_work survey_work;
+static struct k_work prune_work;
+static struct k_work restore_work;
+static struct k_work tune_work;
+
+static void hb_recv(const struct bt_mesh_hb_sub *sub, uint8_t hops, uint16_t feat)
+{
+	if (sub->src != prune.hb_src) {
+		return;
+	}
+
+	prune.hb_hops = hops;
+	k_sem_give(&hb_sem);
+}
+
+BT_MESH_HB_CB_DEFINE(relay_prune_hb_cb) = {
+	.recv = hb_recv,
+};
+
+static int hb_sub_set(uint16_t src)
+{
+	struct bt_mesh_cfg_cli_hb_sub sub = {
+		.src = src,
+		.dst = src ? prune.elem->addr : BT_MESH_ADDR_UNASSIGNED,
+		.period = src ? HB_SUB_PERIOD_LOG : 0,
+	};
+	uint8_t status;
+	int err;
+
+	err = bt_mesh_cfg_cli_hb_sub_set(BT_MESH_NET_PRIMARY, prune.elem->addr, &sub, &status);
+
+	return err ? err : (status ? -EIO : 0);
+}
+
+/* Ask a node for a single heartbeat, returns the number of hops it took or
+ * HOPS_UNKNOWN if the node didn't answer.
+ */
+static uint8_t node_hops(uint16_t addr)
+{
+	struct bt_mesh_cfg_cli_hb_pub pub = {
+		.dst = prune.elem->addr,
+		.count = HB_PUB_COUNT_LOG,
+		.period = HB_PUB_PERIOD_LOG,
+		.ttl = BT_MESH_TTL_MAX,
+		.net_idx = BT_MESH_NET_PRIMARY,
+	};
+	uint8_t status;
+	int err;
+
+	prune.hb_src = addr;
+	k_sem_reset(&hb_sem);
+
+	if (hb_sub_set(addr)) {
+		return HOPS_UNKNOWN;
+	}
+
+	err = bt_mesh_cfg_cli_hb_pub_set(BT_MESH_NET_PRIMARY, addr, &pub, &status);
+	if (err || status || k_sem_take(&hb_sem, HB_TIMEOUT)) {
+		return HOPS_UNKNOWN;
+	}
+
+	return prune.hb_hops;
+}
+
+static void survey(void)
+{
+	for (int i = 0; i < active_nodes.len; i++) {
+		uint16_t addr = active_nodes.nodes[i];
+
+		if (addr == 0) {
+			continue;
+		}
+
+		prune.hops[i] = node_hops(addr);
+		link_stats_hops_set(i, prune.hops[i]);
+		shell_print(prune.shell, "topology %d %d %d %d", addr, prune.hops[i],
+			    link_stats_rssi(i), link_stats_ttl(i));
+	}
+
+	(void)hb_sub_set(BT_MESH_ADDR_UNASSIGNED);
+	shell_print(prune.shell, "topology done");
+}
+
+static uint8_t zone_idx(int node_idx)
+{
+	uint8_t zone = campaign_node_zone(active_nodes.nodes[node_idx]);
+
+	return zone == CAMPAIGN_NO_ZONE ? ZONE_NONE_IDX : zone;
+}
+
+/* A node relays for the nodes one hop further away from the gateway. In every
+ * zone, the few first hop nodes with the strongest link keep relaying if the
+ * zone has nodes further away. The gateway only hears the RSSI of the last
+ * relay of nodes further away, which says nothing of their own links, so their
+ * layers aren't ranked and all of their nodes that have nodes behind them keep
+ * relaying. Nodes with an unknown hop count are left alone.
+ */
+static void relay_set_compute(void)
+{
+	uint8_t max_hops[ZONE_NONE_IDX + 1] = { 0 };
+	int len = active_nodes.len;
+
+	for (int i = 0; i < len; i++) {
+		if (active_nodes.nodes[i] != 0) {
+			max_hops[zone_idx(i)] = MAX(max_hops[zone_idx(i)], prune.hops[i]);
+		}
+	}
+
+	for (int i = 0; i < len; i++) {
+		uint8_t zone = zone_idx(i);
+		int stronger = 0;
+
+		if (active_nodes.nodes[i] == 0 || prune.hops[i] == HOPS_UNKNOWN) {
+			atomic_set_bit(prune.keep, i);
+			continue;
+		}
+
+		if (prune.hops[i] >= max_hops[zone]) {
+			atomic_clear_bit(prune.keep, i);
+			continue;
+		}
+
+		if (prune.hops[i] > 1) {
+			atomic_set_bit(prune.keep, i);
+			continue;
+		}
+
+		for (int j = 0; j < len; j++) {
+			if (j != i && active_nodes.nodes[j] != 0 && zone_idx(j) == zone &&
+			    prune.hops[j] == prune.hops[i] &&
+			    (link_stats_rssi(j) > link_stats_rssi(i) ||
+			     (link_stats_rssi(j) == link_stats_rssi(i) && j < i))) {
+				stronger++;
+			}
+		}
+
+		atomic_set_bit_to(prune.keep, i,
+				  stronger < CONFIG_BT_MESH_LIGHT_MONITOR_RELAYS_PER_LAYER);
+	}
+}
+
+static int relay_apply(int idx, uint8_t relay, uint8_t transmit)
+{
+	uint8_t status;
+	uint8_t transmit_rsp;
+
+	return bt_mesh_cfg_cli_relay_set(BT_MESH_NET_PRIMARY, active_nodes.nodes[idx], relay,
+					 transmit, &status, &transmit_rsp);
+}
+
+static void relay_restore_all(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(prune.relay_prev); i++) {
+		if (prune.relay_prev[i] == RELAY_UNCHANGED) {
+			continue;
+		}
+
+		if (relay_apply(i, prune.relay_prev[i], prune.transmit_prev[i])) {
+			shell_print(prune.shell, "relay restore failed %d", active_nodes.nodes[i]);
+			continue;
+		}
+
+		shell_print(prune.shell, "relay %d %d", active_nodes.nodes[i],
+			    prune.relay_prev[i] == BT_MESH_RELAY_ENABLED);
+		prune.relay_prev[i] = RELAY_UNCHANGED;
+	}
+}
+
+static void prune_work_handler(struct k_work *work)
+{
+	int len = active_nodes.len;
+	uint16_t disabled = 0;
+
+	survey();
+	relay_set_compute();
+
+	for (int i = 0; i < len; i++) {
+		uint8_t relay;
+		uint8_t transmit;
+		bool keep = atomic_test_bit(prune.keep, i);
+		uint8_t want = keep ? BT_MESH_RELAY_ENABLED : BT_MESH_RELAY_DISABLED;
+
+		if (active_nodes.nodes[i] == 0 || prune.hops[i] == HOPS_UNKNOWN ||
+		    bt_mesh_cfg_cli_relay_get(BT_MESH_NET_PRIMARY, active_nodes.nodes[i], &relay,
+					      &transmit)) {
+			continue;
+		}
+
+		if (relay == BT_MESH_RELAY_NOT_SUPPORTED || relay == want) {
+			disabled += (relay == BT_MESH_RELAY_DISABLED);
+			continue;
+		}
+
+		if (relay_apply(i, want, transmit)) {
+			continue;
+		}
+
+		/* Keep the original state over repeated pruning */
+		if (prune.relay_prev[i] == RELAY_UNCHANGED) {
+			prune.relay_prev[i] = relay;
+			prune.transmit_prev[i] = transmit;
+		}
+
+		disabled += !keep;
+		shell_print(prune.shell, "relay %d %d", active_nodes.nodes[i], keep);
+	}
+
+	k_sleep(RELAY_SETTLE_TIME);
+
+	for (int i = 0; i < len; i++) {
+		if (active_nodes.nodes[i] == 0 || prune.hops[i] == HOPS_UNKNOWN ||
+		    node_hops(active_nodes.nodes[i]) != HOPS_UNKNOWN) {
+			continue;
+		}
+
+		shell_print(prune.shell, "relay rollback %d", active_nodes.nodes[i]);
+		relay_restore_all();
+		disabled = 0;
+		break;
+	}
+
+	(void)hb_sub_set(BT_MESH_ADDR_UNASSIGNED);
+	shell_print(prune.shell, "relay prune done %d", disabled);
+	prune.busy = false;
+}
+
+/* Every hop is another chance to lose a message, so the retransmissions go to
+ * the nodes far from the gateway. The nodes close to it, and all nodes of a
+ * large site, send fewer copies to leave the airtime to them. Only the relays
+ * that are kept repeat, and the pushed results are covered by the
+ * acknowledgment of the gateway, so a few copies are enough there.
+ */
+static void tx_plan_compute(int idx, uint16_t nodes, uint8_t max_hops, struct tx_plan *plan)
+{
+	uint8_t base = nodes <= TUNE_SMALL_SITE ? 2 : (nodes <= TUNE_LARGE_SITE ? 1 : 0);
+	uint8_t hops = prune.hops[idx] == HOPS_UNKNOWN ? max_hops : prune.hops[idx];
+	bool large = nodes > TUNE_LARGE_SITE;
+
+	plan->net = BT_MESH_TRANSMIT(MIN(base + hops / 2, TUNE_NET_RETX_MAX), large ? 40 : 20);
+	plan->relay = BT_MESH_TRANSMIT(MAX(base, 1), large ? 40 : 20);
+	plan->pub = BT_MESH_PUB_TRANSMIT(hops > 1 ? MIN(MAX(base, 1) + (hops - 2) / 2,
+							TUNE_PUB_RETX_MAX) : 0,
+					 large ? 200 : 100);
+}
+
+/* Push the planned transmit settings without waiting for the node. The relay
+ * transmit is only pushed to the relays the gateway kept itself, as the relay
+ * state of the other nodes isn't known without asking them. The publication
+ * transmit is set along with the rest of the publication parameters, so it is
+ * left to tx_verify().
+ */
+static int tx_push(int idx, const struct tx_plan *plan)
+{
+	uint16_t addr = active_nodes.nodes[idx];
+	int err;
+
+	err = bt_mesh_cfg_cli_net_transmit_set(BT_MESH_NET_PRIMARY, addr, plan->net, NULL);
+	if (err) {
+		return err;
+	}
+
+	k_sleep(TUNE_PACE);
+
+	if (prune.relay_prev[idx] != RELAY_UNCHANGED && atomic_test_bit(prune.keep, idx)) {
+		err = bt_mesh_cfg_cli_relay_set(BT_MESH_NET_PRIMARY, addr, BT_MESH_RELAY_ENABLED,
+						plan->relay, NULL, NULL);
+		if (err) {
+			return err;
+		}
+
+		k_sleep(TUNE_PACE);
+	}
+
+	return 0;
+}
+
+/* Read the transmit settings of a node back, and set the ones that differ
+ * from the plan. Every setting set must be answered with the planned value.
+ */
+static int tx_verify(int idx, const struct tx_plan *plan)
+{
+	uint16_t addr = active_nodes.nodes[idx];
+	struct bt_mesh_cfg_cli_mod_pub pub;
+	uint8_t transmit;
+	uint8_t relay;
+	uint8_t status;
+	int err;
+
+	err = bt_mesh_cfg_cli_net_transmit_get(BT_MESH_NET_PRIMARY, addr, &transmit);
+	if (err) {
+		return err;
+	}
+
+	if (transmit != plan->net) {
+		err = bt_mesh_cfg_cli_net_transmit_set(BT_MESH_NET_PRIMARY, addr, plan->net,
+						       &transmit);
+		if (err || transmit != plan->net) {
+			return err ? err : -EIO;
+		}
+	}
+
+	err = bt_mesh_cfg_cli_relay_get(BT_MESH_NET_PRIMARY, addr, &relay, &transmit);
+	if (err) {
+		return err;
+	}
+
+	if (relay == BT_MESH_RELAY_ENABLED && transmit != plan->relay) {
+		err = bt_mesh_cfg_cli_relay_set(BT_MESH_NET_PRIMARY, addr, relay, plan->relay,
+						&relay, &transmit);
+		if (err || transmit != plan->relay) {
+			return err ? err : -EIO;
+		}
+	}
+
+	err = bt_mesh_cfg_cli_mod_pub_get_vnd(BT_MESH_NET_PRIMARY, addr, addr,
+					      BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID,
+					      BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID, &pub, &status);
+	if (err || status) {
+		return err ? err : -EIO;
+	}
+
+	if (pub.addr != BT_MESH_ADDR_UNASSIGNED && pub.transmit != plan->pub) {
+		pub.transmit = plan->pub;
+		err = bt_mesh_cfg_cli_mod_pub_set_vnd(BT_MESH_NET_PRIMARY, addr, addr,
+						      BT_MESH_LIGHT_MONITOR_SRV_MODEL_ID,
+						      BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID, &pub,
+						      &status);
+		if (err || status) {
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/* The settings of the whole roster are pushed first, without reading them.
+ * Once the network has settled, every node is read back once, and the
+ * settings it didn't take are set again, one answer at a time.
+ */
+static void tune_work_handler(struct k_work *work)
+{
+	int len = active_nodes.len;
+	uint16_t nodes = 0;
+	uint16_t tuned = 0;
+	uint16_t failed = 0;
+	uint8_t max_hops = 1;
+	struct tx_plan plan;
+	int err;
+
+	survey();
+
+	for (int i = 0; i < len; i++) {
+		if (active_nodes.nodes[i] != 0) {
+			nodes++;
+			max_hops = MAX(max_hops, prune.hops[i]);
+		}
+	}
+
+	for (int i = 0; i < len; i++) {
+		if (active_nodes.nodes[i] == 0) {
+			continue;
+		}
+
+		/* A push that couldn't be sent is caught by the verification */
+		tx_plan_compute(i, nodes, max_hops, &plan);
+		(void)tx_push(i, &plan);
+	}
+
+	k_sleep(TUNE_SETTLE_TIME);
+
+	for (int i = 0; i < len; i++) {
+		if (active_nodes.nodes[i] == 0) {
+			continue;
+		}
+
+		tx_plan_compute(i, nodes, max_hops, &plan);
+		err = tx_verify(i, &plan);
+		if (err) {
+			failed++;
+			shell_print(prune.shell, "transmit failed %d %d", active_nodes.nodes[i], err);
+			continue;
+		}
+
+		tuned++;
+		shell_print(prune.shell, "transmit %d %d %d %d", active_nodes.nodes[i],
+			    BT_MESH_TRANSMIT_COUNT(plan.net), BT_MESH_TRANSMIT_COUNT(plan.relay),
+			    BT_MESH_PUB_TRANSMIT_COUNT(plan.pub));
+	}
+
+	shell_print(prune.shell, "transmit done %d %d %d", nodes, tuned, failed);
+	prune.busy = false;
+}
+
+static void survey_work_handler(struct k_work *work)
+{
+	survey();
+	prune.busy = false;
+}
+
+static void restore_work_handler(struct k_work *work)
+{
+	relay_restore_all();
+	shell_print(prune.shell, "relay restore done");
+	prune.busy = false;
+}
+
+static int prune_submit(struct k_work *work)
+{
+	if (prune.busy) {
+		return -EBUSY;
+	}
+
+	prune.busy = true;
+	(void)k_work_submit_to_queue(cfg_cli_workq(), work);
+
+	return 0;
+}
+
+int relay_prune_survey(void)
+{
+	return prune_submit(&survey_work);
+}
+
+int relay_prune_start(void)
+{
+	return prune_submit(&prune_work);
+}
+
+int relay_prune_restore(void)
+{
+	return prune_submit(&restore_work);
+}
+
+int relay_prune_tune(void)
+{
+	return prune_submit(&tune_work);
+}
+
+void relay_prune_init(const struct bt_mesh_elem *elem, const struct shell *sh)
+{
+	prune.shell = sh;
+	prune.elem = elem;
+	memset(prune.relay_prev, RELAY_UNCHANGED, sizeof(prune.relay_prev));
+
+	k_work_init(&survey_work, survey_work_handler);
+	k_work_init(&prune_work, prune_work_handler);
+	k_work_init(&restore_work, restore_work_handler);
+	k_work_init(&tune_work, tune_work_handler);
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/shell/shell.h>
+#include "result_ring.h"
+#include "light_monitor_workq.h"
+
+#define RING_AREA_ID FIXED_PARTITION_ID(result_ring)
+#define RING_MAGIC 0x4c4d5252
+#define RING_VERSION 1
+/* nRF52 flash pages are 4 kB */
+#define RING_SECTOR_MAX (CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_RING_SIZE / 0x1000)
+/* Entries waiting for the flash, a sweep's results can land all at once */
+#define RING_QUEUE_LEN 32
+
+struct result_ring_entry {
+	uint32_t seq;
+	uint32_t time_stamp;
+	uint16_t addr;
+	uint8_t result;
+	uint8_t reserved;
+};
+
+static struct flash_sector ring_sectors[RING_SECTOR_MAX];
+static struct fcb ring_fcb;
+static const struct shell *ring_shell;
+static uint32_t ring_seq;
+static bool ring_ready;
+/* While held, the stored entries are acknowledged all at once on release */
+static atomic_t ring_held;
+
+K_MSGQ_DEFINE(ring_queue, sizeof(struct result_ring_entry), RING_QUEUE_LEN, 4);
+
+static int entry_read(struct fcb_entry_ctx *ctx, struct result_ring_entry *entry)
+{
+	if (ctx->loc.fe_data_len != sizeof(*entry)) {
+		return -EINVAL;
+	}
+
+	return flash_area_read(ctx->fap, FCB_ENTRY_FA_DATA_OFF(ctx->loc), entry, sizeof(*entry));
+}
+
+static int entry_write(struct result_ring_entry *entry)
+{
+	struct fcb_entry loc;
+	int err;
+
+	err = fcb_append(&ring_fcb, sizeof(*entry), &loc);
+	if (err == -ENOSPC) {
+		/* Full, drop the oldest page */
+		err = fcb_rotate(&ring_fcb);
+		if (!err) {
+			err = fcb_append(&ring_fcb, sizeof(*entry), &loc);
+		}
+	}
+
+	if (err) {
+		return err;
+	}
+
+	err = flash_area_write(ring_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), entry, sizeof(*entry));
+	if (err) {
+		return err;
+	}
+
+	return fcb_append_finish(&ring_fcb, &loc);
+}
+
+static void ring_work_handler(struct k_work *work)
+{
+	struct result_ring_entry entry;
+
+	while (!k_msgq_get(&ring_queue, &entry, K_NO_WAIT)) {
+		int err;
+
+		entry.seq = ++ring_seq;
+		err = entry_write(&entry);
+		if (err) {
+			shell_print(ring_shell, "Could not store the result of %d (err %d)", entry.addr,
+				    err);
+			continue;
+		}
+
+		if (!atomic_get(&ring_held)) {
+			shell_print(ring_shell, "stored %u", entry.seq);
+		}
+	}
+}
+
+static K_WORK_DEFINE(ring_work, ring_work_handler);
+
+int result_ring_append(uint16_t addr, bool result, uint32_t time_stamp)
+{
+	struct result_ring_entry entry = {
+		.time_stamp = time_stamp,
+		.addr = addr,
+		.result = result,
+	};
+	int err;
+
+	if (!ring_ready) {
+		return -EAGAIN;
+	}
+
+	err = k_msgq_put(&ring_queue, &entry, K_NO_WAIT);
+	if (err) {
+		return err;
+	}
+
+	(void)k_work_submit_to_queue(light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG), &ring_work);
+
+	return 0;
+}
+
+void result_ring_hold(void)
+{
+	atomic_set(&ring_held, 1);
+}
+
+void result_ring_release(void)
+{
+	if (atomic_set(&ring_held, 0) && ring_seq) {
+		shell_print(ring_shell, "stored %u", ring_seq);
+	}
+}
+
+static int replay_cb(struct fcb_entry_ctx *ctx, void *arg)
+{
+	uint32_t seq = *(uint32_t *)arg;
+	struct result_ring_entry entry;
+
+	if (entry_read(ctx, &entry) || entry.seq <= seq) {
+		return 0;
+	}
+
+	/* Printed as a log entry, the host keeps entries it already has once */
+	shell_print(ring_shell, "logged %d %u %d", entry.result, entry.time_stamp, entry.addr);
+	shell_print(ring_shell, "stored %u", entry.seq);
+
+	return 0;
+}
+
+int result_ring_replay(uint32_t seq)
+{
+	if (!ring_ready) {
+		return -EAGAIN;
+	}
+
+	return fcb_walk(&ring_fcb, NULL, replay_cb, &seq);
+}
+
+static int last_seq_cb(struct fcb_entry_ctx *ctx, void *arg)
+{
+	struct result_ring_entry entry;
+
+	if (!entry_read(ctx, &entry)) {
+		ring_seq = MAX(ring_seq, entry.seq);
+	}
+
+	return 0;
+}
+
+int result_ring_init(const struct shell *sh)
+{
+	uint32_t sector_cnt = ARRAY_SIZE(ring_sectors);
+	int err;
+
+	ring_shell = sh;
+
+	err = flash_area_get_sectors(RING_AREA_ID, &sector_cnt, ring_sectors);
+	if (err) {
+		return err;
+	}
+
+	ring_fcb.f_magic = RING_MAGIC;
+	ring_fcb.f_version = RING_VERSION;
+	ring_fcb.f_sectors = ring_sectors;
+	ring_fcb.f_sector_cnt = sector_cnt;
+
+	err = fcb_init(RING_AREA_ID, &ring_fcb);
+	if (err) {
+		return err;
+	}
+
+	err = fcb_walk(&ring_fcb, NULL, last_seq_cb, NULL);
+	if (err) {
+		return err;
+	}
+
+	ring_ready = true;
+
+	return 0;
+}
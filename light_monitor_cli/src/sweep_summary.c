@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+#include "model_handler.h"
+#include "result_ring.h"
+#include "sweep_summary.h"
+
+#define ROSTER_BYTES DIV_ROUND_UP(ARRAY_SIZE(active_nodes.nodes), 8)
+
+static struct {
+	const struct shell *shell;
+	uint8_t pass[ROSTER_BYTES];
+	uint8_t fail[ROSTER_BYTES];
+	uint8_t missing[ROSTER_BYTES];
+	uint32_t start;
+	bool active;
+} sweep;
+
+static char hex[ROSTER_BYTES * 2 + 1];
+
+static const char *bitmap_hex(const uint8_t *bitmap, int len)
+{
+	if (!bin2hex(bitmap, DIV_ROUND_UP(len, 8), hex, sizeof(hex))) {
+		hex[0] = '\0';
+	}
+
+	return len ? hex : "-";
+}
+
+void sweep_summary_start(void)
+{
+	memset(sweep.pass, 0, sizeof(sweep.pass));
+	memset(sweep.fail, 0, sizeof(sweep.fail));
+	sweep.start = current_time_stamp();
+	sweep.active = true;
+	result_ring_hold();
+}
+
+bool sweep_summary_active(void)
+{
+	return sweep.active;
+}
+
+uint32_t sweep_summary_time_stamp(void)
+{
+	return sweep.start;
+}
+
+void sweep_summary_result(uint16_t addr, bool passed)
+{
+	int idx = active_nodes_find(addr);
+
+	if (!sweep.active || idx < 0) {
+		return;
+	}
+
+	/* A later result replaces an earlier one */
+	WRITE_BIT(sweep.pass[idx / 8], idx % 8, passed);
+	WRITE_BIT(sweep.fail[idx / 8], idx % 8, !passed);
+}
+
+void sweep_summary_finish(void)
+{
+	int len = active_nodes.len;
+
+	if (!sweep.active) {
+		return;
+	}
+
+	sweep.active = false;
+
+	memset(sweep.missing, 0, sizeof(sweep.missing));
+	for (int i = 0; i < len; i++) {
+		WRITE_BIT(sweep.missing[i / 8], i % 8,
+			  active_nodes.nodes[i] != 0 && !(sweep.pass[i / 8] & BIT(i % 8)) &&
+				  !(sweep.fail[i / 8] & BIT(i % 8)));
+	}
+
+	/* The shell writes the record as it goes, so one hex buffer is enough */
+	shell_fprintf(sweep.shell, SHELL_NORMAL, "sweep %08x %u %u %d ", roster_crc(),
+		      sweep.start, current_time_stamp(), len);
+	shell_fprintf(sweep.shell, SHELL_NORMAL, "%s ", bitmap_hex(sweep.pass, len));
+	shell_fprintf(sweep.shell, SHELL_NORMAL, "%s ", bitmap_hex(sweep.fail, len));
+	shell_fprintf(sweep.shell, SHELL_NORMAL, "%s\n", bitmap_hex(sweep.missing, len));
+
+	result_ring_release();
+}
+
+void sweep_summary_init(const struct shell *sh)
+{
+	sweep.shell = sh;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @defgroup bt_mesh_light_monitor_msg
+ * @{
+ * @brief Messages of the Bluetooth Mesh Light Monitor models.
+ *
+ * Opcodes, payload lengths and encoding of every message exchanged between
+ * the Light Monitor Client and Server models. Every message is checked at
+ * compile time to fit an unsegmented access PDU.
+ */
+
+#ifndef BT_MESH_LIGHT_MONITOR_MSG_H__
+#define BT_MESH_LIGHT_MONITOR_MSG_H__
+
+#include <zephyr/bluetooth/mesh.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID 0x0059
+
+#define BT_MESH_LIGHT_MONITOR_OP(_op)                                                              \
+	BT_MESH_MODEL_OP_3(_op, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
+
+/* Client to server */
+#define GET_STATUS_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x01)
+#define TEST_START_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x05)
+#define GET_LOG_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x07)
+#define GET_ACK_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x08)
+#define GET_RESULT_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x0A)
+#define CALIBRATE_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x0C)
+#define RESULT_ACK_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x0E)
+#define SCHEDULE_SET_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x0F)
+
+/* Server to client */
+#define TEST_ACK_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x02)
+#define TEST_RESULT_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x03)
+#define UPDATE_STATUS_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x04)
+#define RESULT_LOG_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x06)
+#define GET_START_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x09)
+#define CALIBRATE_OK_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x0D)
+#define SCHEDULE_STATUS_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x10)
+#define TEST_PROGRESS_OPCODE BT_MESH_LIGHT_MONITOR_OP(0x11)
+
+/* 0x0B was the unused Get Test Start message and is reserved */
+
+#define GET_STATUS_LEN 0
+#define TEST_START_LEN 2
+#define GET_LOG_LEN 0
+#define GET_ACK_LEN 0
+#define GET_RESULT_LEN 0
+#define CALIBRATE_LEN 4
+#define RESULT_ACK_LEN 2
+#define SCHEDULE_SET_LEN 8
+
+#define TEST_ACK_LEN 0
+#define TEST_RESULT_LEN 8
+#define STATUS_UPDATE_LEN 2
+#define RESULT_LOG_LEN 4
+#define GET_START_LEN 0
+#define CALIBRATE_OK_LEN 6
+#define SCHEDULE_STATUS_LEN 8
+#define TEST_PROGRESS_LEN 8
+
+/** Largest access payload, opcode included, sent in a single unsegmented PDU. */
+#define BT_MESH_LIGHT_MONITOR_UNSEG_MAX 11
+
+/** Largest log entry age in minutes that fits the 24 bit age field. */
+#define RESULT_LOG_AGE_MAX 0xFFFFFE
+/** The logged test ran before the node received the network time. */
+#define RESULT_LOG_AGE_UNKNOWN 0xFFFFFF
+/** Bit of the result byte of a log entry the gateway already acknowledged. */
+#define RESULT_LOG_REPORTED BIT(1)
+
+/** Resolution of the time the light took to come on, in microseconds. */
+#define LIGHT_DELAY_UNIT_US 200
+/** The light didn't come on within the switchover capture, or wasn't measured. */
+#define LIGHT_DELAY_NONE 0x7FFF
+
+/** Resolution of the window calibration replies are spread over, in milliseconds. */
+#define CALIBRATE_WINDOW_UNIT_MS 100
+
+/** Mesh TAI time counts from 2000-01-01T00:00:00 TAI. */
+#define MESH_TAI_EPOCH_UNIX 946684800
+
+/** Test Start message. */
+struct light_monitor_test_start {
+	/** Test duration in seconds. */
+	uint16_t duration;
+};
+
+/** Test Result message, and the Result Ack answering it. */
+struct light_monitor_test_result {
+	/** Whether the test passed. */
+	bool result;
+	/** Sequence number of the result. */
+	uint16_t seq;
+	/** Lowest supply voltage during the test, in millivolts. */
+	uint16_t vdd_mv;
+	/** Lowest battery voltage during the test, in millivolts. */
+	int16_t batt_mv;
+	/** Time from the start of the test until the light came on, in units of
+	 *  LIGHT_DELAY_UNIT_US, or LIGHT_DELAY_NONE. Shares a field with the result.
+	 */
+	uint16_t light_delay;
+};
+
+/** Calibrate message. */
+struct light_monitor_calibrate {
+	/** Calibration round, a server calibrates once per round and repeats its
+	 *  answer when asked again.
+	 */
+	uint16_t seq;
+	/** Window the answers are spread over, in units of CALIBRATE_WINDOW_UNIT_MS.
+	 *  0 to answer right away.
+	 */
+	uint16_t window;
+};
+
+/** Calibrate OK message. */
+struct light_monitor_calibrate_status {
+	/** Calibration round that is answered. */
+	uint16_t seq;
+	/** New failure threshold, as an LDR resistance. */
+	uint16_t threshold;
+	/** Spread (highest minus lowest) of the calibration readings. */
+	uint16_t noise;
+};
+
+/** Status Update message. */
+struct light_monitor_status_update {
+	/** Current sensor value. */
+	uint16_t value;
+};
+
+/** Result Log message. */
+struct light_monitor_result_log {
+	/** Whether the logged test passed. */
+	bool result;
+	/** Whether the gateway acknowledged the result when it was sent. */
+	bool reported;
+	/** Minutes since the logged test was started, or @ref RESULT_LOG_AGE_UNKNOWN. */
+	uint32_t age;
+};
+
+/** Test Progress message, published by a server while a test runs. */
+struct light_monitor_test_progress {
+	/** Seconds since the test started. */
+	uint16_t elapsed;
+	/** Darkest (highest) LDR reading so far in the test. */
+	uint16_t darkest;
+	/** Current LDR reading. */
+	uint16_t current;
+	/** Failure threshold minus the current reading, negative once failed. */
+	int16_t margin;
+};
+
+/** Autonomous test schedule of a server. A period of 0 disables the test. */
+struct test_schedule {
+	/** Days between functional tests. */
+	uint8_t fn_period;
+	/** Functional test duration in seconds. */
+	uint16_t fn_duration;
+	/** Days between full duration tests. */
+	uint16_t full_period;
+	/** Full duration test duration in minutes. */
+	uint8_t full_duration;
+	/** Minutes from the schedule start to the first test of the node. */
+	uint16_t offset;
+};
+
+/* The encoders initialize the buffer with the opcode and add the payload, and
+ * the decoders pull the payload of a received message. Decoders return
+ * -EMSGSIZE if the message is too short. Messages without parameters consist
+ * of the opcode only, see bt_mesh_model_msg_init().
+ */
+
+void light_monitor_test_start_encode(struct net_buf_simple *buf,
+				     const struct light_monitor_test_start *msg);
+int light_monitor_test_start_decode(struct net_buf_simple *buf,
+				    struct light_monitor_test_start *msg);
+
+void light_monitor_test_result_encode(struct net_buf_simple *buf,
+				      const struct light_monitor_test_result *msg);
+int light_monitor_test_result_decode(struct net_buf_simple *buf,
+				     struct light_monitor_test_result *msg);
+
+void light_monitor_calibrate_encode(struct net_buf_simple *buf,
+				    const struct light_monitor_calibrate *msg);
+int light_monitor_calibrate_decode(struct net_buf_simple *buf, struct light_monitor_calibrate *msg);
+
+void light_monitor_calibrate_status_encode(struct net_buf_simple *buf,
+					   const struct light_monitor_calibrate_status *msg);
+int light_monitor_calibrate_status_decode(struct net_buf_simple *buf,
+					  struct light_monitor_calibrate_status *msg);
+
+void light_monitor_result_ack_encode(struct net_buf_simple *buf, uint16_t seq);
+int light_monitor_result_ack_decode(struct net_buf_simple *buf, uint16_t *seq);
+
+void light_monitor_status_update_encode(struct net_buf_simple *buf,
+					const struct light_monitor_status_update *msg);
+int light_monitor_status_update_decode(struct net_buf_simple *buf,
+				       struct light_monitor_status_update *msg);
+
+void light_monitor_result_log_encode(struct net_buf_simple *buf,
+				     const struct light_monitor_result_log *msg);
+int light_monitor_result_log_decode(struct net_buf_simple *buf,
+				    struct light_monitor_result_log *msg);
+
+void light_monitor_test_progress_encode(struct net_buf_simple *buf,
+					const struct light_monitor_test_progress *msg);
+int light_monitor_test_progress_decode(struct net_buf_simple *buf,
+				       struct light_monitor_test_progress *msg);
+
+/** @brief Encode a Schedule Set or Schedule Status message.
+ *
+ * @param[out] buf Buffer to encode the message in.
+ * @param[in] opcode SCHEDULE_SET_OPCODE or SCHEDULE_STATUS_OPCODE.
+ * @param[in] schedule Test schedule.
+ */
+void light_monitor_schedule_encode(struct net_buf_simple *buf, uint32_t opcode,
+				   const struct test_schedule *schedule);
+int light_monitor_schedule_decode(struct net_buf_simple *buf, struct test_schedule *schedule);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BT_MESH_LIGHT_MONITOR_MSG_H__ */
+
+/** @} */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @defgroup bt_mesh_light_monitor_workq
+ * @{
+ * @brief Work queues of the light monitor applications.
+ *
+ * The application's work is split over three queues of decreasing priority,
+ * so a blocking ADC read or a slow UART never holds up the mesh stack on the
+ * system workqueue, and host output never delays a test or a reply:
+ *
+ * - Sample: sensor sampling and test timing.
+ * - Reply: messages to the other nodes.
+ * - Log: host output, flash and indication.
+ *
+ * With @kconfig{CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS}, every queue is
+ * probed periodically for the delay between submitting work and running it,
+ * and for the unused part of its stack.
+ */
+
+#ifndef BT_MESH_LIGHT_MONITOR_WORKQ_H__
+#define BT_MESH_LIGHT_MONITOR_WORKQ_H__
+
+#include <zephyr/kernel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Work queues, highest priority first. */
+enum light_monitor_workq {
+	LIGHT_MONITOR_WORKQ_SAMPLE,
+	LIGHT_MONITOR_WORKQ_REPLY,
+	LIGHT_MONITOR_WORKQ_LOG,
+
+	LIGHT_MONITOR_WORKQ_COUNT,
+};
+
+/** Work queue instrumentation. */
+struct light_monitor_workq_stats {
+	/** Name of the queue thread. */
+	const char *name;
+	/** Delay of the last probe, in microseconds. */
+	uint32_t latency_us;
+	/** Longest delay of a probe since boot, in microseconds. */
+	uint32_t latency_max_us;
+	/** Number of probes run. */
+	uint32_t probes;
+	/** Stack size, in bytes. */
+	size_t stack_size;
+	/** Stack never used since boot, in bytes. */
+	size_t stack_unused;
+};
+
+/** @brief Start the work queues.
+ *
+ * Must be called before any work is submitted to them.
+ */
+void light_monitor_workq_init(void);
+
+/** @brief Get a work queue.
+ *
+ * @param[in] wq Work queue.
+ *
+ * @return Work queue to submit to.
+ */
+struct k_work_q *light_monitor_workq(enum light_monitor_workq wq);
+
+/** @brief Get the instrumentation of a work queue.
+ *
+ * @param[in] wq Work queue.
+ * @param[out] stats Instrumentation of the queue.
+ *
+ * @return 0 on success, or (negative) error code on failure.
+ * @retval -ENOTSUP The instrumentation is not enabled.
+ */
+int light_monitor_workq_stats_get(enum light_monitor_workq wq,
+				  struct light_monitor_workq_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BT_MESH_LIGHT_MONITOR_WORKQ_H__ */
+
+/** @} */
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/bluetooth/mesh.h>
+#include "light_monitor_msg.h"
+
+#define MSG_FITS_UNSEG(_op, _len)                                                                  \
+	BUILD_ASSERT(BT_MESH_MODEL_OP_LEN(_op) + (_len) <= BT_MESH_LIGHT_MONITOR_UNSEG_MAX,        \
+		     #_op " does not fit an unsegmented access PDU")
+
+MSG_FITS_UNSEG(GET_STATUS_OPCODE, GET_STATUS_LEN);
+MSG_FITS_UNSEG(TEST_START_OPCODE, TEST_START_LEN);
+MSG_FITS_UNSEG(GET_LOG_OPCODE, GET_LOG_LEN);
+MSG_FITS_UNSEG(GET_ACK_OPCODE, GET_ACK_LEN);
+MSG_FITS_UNSEG(GET_RESULT_OPCODE, GET_RESULT_LEN);
+MSG_FITS_UNSEG(CALIBRATE_OPCODE, CALIBRATE_LEN);
+MSG_FITS_UNSEG(RESULT_ACK_OPCODE, RESULT_ACK_LEN);
+MSG_FITS_UNSEG(SCHEDULE_SET_OPCODE, SCHEDULE_SET_LEN);
+MSG_FITS_UNSEG(TEST_ACK_OPCODE, TEST_ACK_LEN);
+MSG_FITS_UNSEG(TEST_RESULT_OPCODE, TEST_RESULT_LEN);
+MSG_FITS_UNSEG(UPDATE_STATUS_OPCODE, STATUS_UPDATE_LEN);
+MSG_FITS_UNSEG(RESULT_LOG_OPCODE, RESULT_LOG_LEN);
+MSG_FITS_UNSEG(GET_START_OPCODE, GET_START_LEN);
+MSG_FITS_UNSEG(CALIBRATE_OK_OPCODE, CALIBRATE_OK_LEN);
+MSG_FITS_UNSEG(SCHEDULE_STATUS_OPCODE, SCHEDULE_STATUS_LEN);
+MSG_FITS_UNSEG(TEST_PROGRESS_OPCODE, TEST_PROGRESS_LEN);
+
+void light_monitor_test_start_encode(struct net_buf_simple *buf,
+				     const struct light_monitor_test_start *msg)
+{
+	bt_mesh_model_msg_init(buf, TEST_START_OPCODE);
+	net_buf_simple_add_le16(buf, msg->duration);
+}
+
+int light_monitor_test_start_decode(struct net_buf_simple *buf,
+				    struct light_monitor_test_start *msg)
+{
+	if (buf->len < TEST_START_LEN) {
+		return -EMSGSIZE;
+	}
+
+	msg->duration = net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_test_result_encode(struct net_buf_simple *buf,
+				      const struct light_monitor_test_result *msg)
+{
+	bt_mesh_model_msg_init(buf, TEST_RESULT_OPCODE);
+	net_buf_simple_add_le16(buf, MIN(msg->light_delay, LIGHT_DELAY_NONE) << 1 | msg->result);
+	net_buf_simple_add_le16(buf, msg->seq);
+	net_buf_simple_add_le16(buf, msg->vdd_mv);
+	net_buf_simple_add_le16(buf, (uint16_t)msg->batt_mv);
+}
+
+int light_monitor_test_result_decode(struct net_buf_simple *buf,
+				     struct light_monitor_test_result *msg)
+{
+	uint16_t result;
+
+	if (buf->len < TEST_RESULT_LEN) {
+		return -EMSGSIZE;
+	}
+
+	result = net_buf_simple_pull_le16(buf);
+	msg->result = result & BIT(0);
+	msg->light_delay = result >> 1;
+	msg->seq = net_buf_simple_pull_le16(buf);
+	msg->vdd_mv = net_buf_simple_pull_le16(buf);
+	msg->batt_mv = (int16_t)net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_result_ack_encode(struct net_buf_simple *buf, uint16_t seq)
+{
+	bt_mesh_model_msg_init(buf, RESULT_ACK_OPCODE);
+	net_buf_simple_add_le16(buf, seq);
+}
+
+int light_monitor_result_ack_decode(struct net_buf_simple *buf, uint16_t *seq)
+{
+	if (buf->len < RESULT_ACK_LEN) {
+		return -EMSGSIZE;
+	}
+
+	*seq = net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_calibrate_encode(struct net_buf_simple *buf,
+				    const struct light_monitor_calibrate *msg)
+{
+	bt_mesh_model_msg_init(buf, CALIBRATE_OPCODE);
+	net_buf_simple_add_le16(buf, msg->seq);
+	net_buf_simple_add_le16(buf, msg->window);
+}
+
+int light_monitor_calibrate_decode(struct net_buf_simple *buf, struct light_monitor_calibrate *msg)
+{
+	if (buf->len < CALIBRATE_LEN) {
+		return -EMSGSIZE;
+	}
+
+	msg->seq = net_buf_simple_pull_le16(buf);
+	msg->window = net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_calibrate_status_encode(struct net_buf_simple *buf,
+					   const struct light_monitor_calibrate_status *msg)
+{
+	bt_mesh_model_msg_init(buf, CALIBRATE_OK_OPCODE);
+	net_buf_simple_add_le16(buf, msg->seq);
+	net_buf_simple_add_le16(buf, msg->threshold);
+	net_buf_simple_add_le16(buf, msg->noise);
+}
+
+int light_monitor_calibrate_status_decode(struct net_buf_simple *buf,
+					  struct light_monitor_calibrate_status *msg)
+{
+	if (buf->len < CALIBRATE_OK_LEN) {
+		return -EMSGSIZE;
+	}
+
+	msg->seq = net_buf_simple_pull_le16(buf);
+	msg->threshold = net_buf_simple_pull_le16(buf);
+	msg->noise = net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_status_update_encode(struct net_buf_simple *buf,
+					const struct light_monitor_status_update *msg)
+{
+	bt_mesh_model_msg_init(buf, UPDATE_STATUS_OPCODE);
+	net_buf_simple_add_le16(buf, msg->value);
+}
+
+int light_monitor_status_update_decode(struct net_buf_simple *buf,
+				       struct light_monitor_status_update *msg)
+{
+	if (buf->len < STATUS_UPDATE_LEN) {
+		return -EMSGSIZE;
+	}
+
+	msg->value = net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_result_log_encode(struct net_buf_simple *buf,
+				     const struct light_monitor_result_log *msg)
+{
+	bt_mesh_model_msg_init(buf, RESULT_LOG_OPCODE);
+	net_buf_simple_add_u8(buf, msg->result | (msg->reported ? RESULT_LOG_REPORTED : 0));
+	net_buf_simple_add_le24(buf, msg->age == RESULT_LOG_AGE_UNKNOWN ?
+					     RESULT_LOG_AGE_UNKNOWN :
+					     MIN(msg->age, RESULT_LOG_AGE_MAX));
+}
+
+int light_monitor_result_log_decode(struct net_buf_simple *buf,
+				    struct light_monitor_result_log *msg)
+{
+	uint8_t flags;
+
+	if (buf->len < RESULT_LOG_LEN) {
+		return -EMSGSIZE;
+	}
+
+	flags = net_buf_simple_pull_u8(buf);
+	msg->result = flags & BIT(0);
+	msg->reported = flags & RESULT_LOG_REPORTED;
+	msg->age = net_buf_simple_pull_le24(buf);
+	return 0;
+}
+
+void light_monitor_test_progress_encode(struct net_buf_simple *buf,
+					const struct light_monitor_test_progress *msg)
+{
+	bt_mesh_model_msg_init(buf, TEST_PROGRESS_OPCODE);
+	net_buf_simple_add_le16(buf, msg->elapsed);
+	net_buf_simple_add_le16(buf, msg->darkest);
+	net_buf_simple_add_le16(buf, msg->current);
+	net_buf_simple_add_le16(buf, (uint16_t)msg->margin);
+}
+
+int light_monitor_test_progress_decode(struct net_buf_simple *buf,
+				       struct light_monitor_test_progress *msg)
+{
+	if (buf->len < TEST_PROGRESS_LEN) {
+		return -EMSGSIZE;
+	}
+
+	msg->elapsed = net_buf_simple_pull_le16(buf);
+	msg->darkest = net_buf_simple_pull_le16(buf);
+	msg->current = net_buf_simple_pull_le16(buf);
+	msg->margin = (int16_t)net_buf_simple_pull_le16(buf);
+	return 0;
+}
+
+void light_monitor_schedule_encode(struct net_buf_simple *buf, uint32_t opcode,
+				   const struct test_schedule *schedule)
+{
+	bt_mesh_model_msg_init(buf, opcode);
+	net_buf_simple_add_u8(buf, schedule->fn_period);
+	net_buf_simple_add_le16(buf, schedule->fn_duration);
+	net_buf_simple_add_le16(buf, schedule->full_period);
+	net_buf_simple_add_u8(buf, schedule->full_duration);
+	net_buf_simple_add_le16(buf, schedule->offset);
+}
+
+int light_monitor_schedule_decode(struct net_buf_simple *buf, struct test_schedule *schedule)
+{
+	if (buf->len < SCHEDULE_SET_LEN) {
+		return -EMSGSIZE;
+	}
+
+	schedule->fn_period = net_buf_simple_pull_u8(buf);
+	schedule->fn_duration = net_buf_simple_pull_le16(buf);
+	schedule->full_period = net_buf_simple_pull_le16(buf);
+	schedule->full_duration = net_buf_simple_pull_u8(buf);
+	schedule->offset = net_buf_simple_pull_le16(buf);
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include "light_monitor_workq.h"
+
+#define PROBE_PERIOD K_MSEC(CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS_PERIOD)
+
+struct workq {
+	struct k_work_q q;
+	const char *name;
+	k_thread_stack_t *stack;
+	size_t stack_size;
+	int prio;
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS
+	struct k_work probe;
+	/* Cycle count when the probe was submitted */
+	uint32_t probe_start;
+	uint32_t latency_us;
+	uint32_t latency_max_us;
+	uint32_t probes;
+#endif
+};
+
+K_THREAD_STACK_DEFINE(sample_stack, CONFIG_BT_MESH_LIGHT_MONITOR_SAMPLE_WQ_STACK_SIZE);
+K_THREAD_STACK_DEFINE(reply_stack, CONFIG_BT_MESH_LIGHT_MONITOR_REPLY_WQ_STACK_SIZE);
+K_THREAD_STACK_DEFINE(log_stack, CONFIG_BT_MESH_LIGHT_MONITOR_LOG_WQ_STACK_SIZE);
+
+static struct workq workqs[LIGHT_MONITOR_WORKQ_COUNT] = {
+	[LIGHT_MONITOR_WORKQ_SAMPLE] = {
+		.name = "lm_sample",
+		.stack = sample_stack,
+		.stack_size = K_THREAD_STACK_SIZEOF(sample_stack),
+		.prio = CONFIG_BT_MESH_LIGHT_MONITOR_SAMPLE_WQ_PRIO,
+	},
+	[LIGHT_MONITOR_WORKQ_REPLY] = {
+		.name = "lm_reply",
+		.stack = reply_stack,
+		.stack_size = K_THREAD_STACK_SIZEOF(reply_stack),
+		.prio = CONFIG_BT_MESH_LIGHT_MONITOR_REPLY_WQ_PRIO,
+	},
+	[LIGHT_MONITOR_WORKQ_LOG] = {
+		.name = "lm_log",
+		.stack = log_stack,
+		.stack_size = K_THREAD_STACK_SIZEOF(log_stack),
+		.prio = CONFIG_BT_MESH_LIGHT_MONITOR_LOG_WQ_PRIO,
+	},
+};
+
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS
+static void probe_handler(struct k_work *work)
+{
+	struct workq *wq = CONTAINER_OF(work, struct workq, probe);
+
+	wq->latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - wq->probe_start);
+	wq->latency_max_us = MAX(wq->latency_max_us, wq->latency_us);
+	wq->probes++;
+}
+
+/* Probes are submitted from a timer, so their delay is only the time spent
+ * queued behind other work and higher priority threads.
+ */
+static void probe_timer_handler(struct k_timer *timer)
+{
+	for (int i = 0; i < ARRAY_SIZE(workqs); i++) {
+		if (k_work_is_pending(&workqs[i].probe)) {
+			continue;
+		}
+
+		workqs[i].probe_start = k_cycle_get_32();
+		(void)k_work_submit_to_queue(&workqs[i].q, &workqs[i].probe);
+	}
+}
+
+static K_TIMER_DEFINE(probe_timer, probe_timer_handler, NULL);
+#endif
+
+void light_monitor_workq_init(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(workqs); i++) {
+		struct k_work_queue_config cfg = {
+			.name = workqs[i].name,
+		};
+
+		k_work_queue_start(&workqs[i].q, workqs[i].stack, workqs[i].stack_size,
+				   workqs[i].prio, &cfg);
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS
+		k_work_init(&workqs[i].probe, probe_handler);
+#endif
+	}
+
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS
+	k_timer_start(&probe_timer, PROBE_PERIOD, PROBE_PERIOD);
+#endif
+}
+
+struct k_work_q *light_monitor_workq(enum light_monitor_workq wq)
+{
+	__ASSERT_NO_MSG(wq < LIGHT_MONITOR_WORKQ_COUNT);
+
+	return &workqs[wq].q;
+}
+
+int light_monitor_workq_stats_get(enum light_monitor_workq wq,
+				  struct light_monitor_workq_stats *stats)
+{
+#ifdef CONFIG_BT_MESH_LIGHT_MONITOR_WORKQ_STATS
+	struct workq *q;
+	int err;
+
+	if (wq >= LIGHT_MONITOR_WORKQ_COUNT) {
+		return -EINVAL;
+	}
+
+	q = &workqs[wq];
+
+	stats->name = q->name;
+	stats->latency_us = q->latency_us;
+	stats->latency_max_us = q->latency_max_us;
+	stats->probes = q->probes;
+	stats->stack_size = q->stack_size;
+
+	err = k_thread_stack_space_get(&q->q.thread, &stats->stack_unused);
+	if (err) {
+		return err;
+	}
+
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Time to encode, and to decode, every message on the host. The firmware is
+ * far slower, but the figures compare the messages and catch regressions.
+ * The number of runs per message is the first argument.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "msg_codecs.h"
+
+#define BENCH_DEFAULT_RUNS 10000000
+/* Random messages cycled through, so the inputs vary but aren't generated
+ * in the timed loop
+ */
+#define BENCH_MSGS 256
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+	long runs = argc > 1 ? strtol(argv[1], NULL, 0) : BENCH_DEFAULT_RUNS;
+	static union msg_any msgs[BENCH_MSGS];
+	static uint8_t encoded[BENCH_MSGS][BT_MESH_LIGHT_MONITOR_UNSEG_MAX];
+	volatile uint32_t sink = 0;
+
+	msg_rand_seed(0x4c4d);
+	printf("%-16s %12s %12s\n", "message", "encode ns", "decode ns");
+
+	for (size_t i = 0; i < msg_codec_count; i++) {
+		const struct msg_codec *codec = &msg_codecs[i];
+		NET_BUF_SIMPLE_DEFINE(buf, BT_MESH_LIGHT_MONITOR_UNSEG_MAX);
+		struct net_buf_simple payload;
+		size_t op_len = BT_MESH_MODEL_OP_LEN(codec->opcode);
+		union msg_any got;
+		double start;
+		double encode_ns;
+		double decode_ns;
+
+		for (int j = 0; j < BENCH_MSGS; j++) {
+			codec->fill(&msgs[j]);
+			codec->encode(&buf, &msgs[j]);
+			memcpy(encoded[j], buf.data + op_len, codec->len);
+		}
+
+		start = now_ns();
+		for (long j = 0; j < runs; j++) {
+			codec->encode(&buf, &msgs[j % BENCH_MSGS]);
+			sink += buf.data[buf.len - 1];
+		}
+		encode_ns = (now_ns() - start) / runs;
+
+		start = now_ns();
+		for (long j = 0; j < runs; j++) {
+			net_buf_simple_init_with_data(&payload, encoded[j % BENCH_MSGS], codec->len);
+			sink += codec->decode(&payload, &got);
+		}
+		decode_ns = (now_ns() - start) / runs;
+
+		printf("%-16s %12.2f %12.2f\n", codec->name, encode_ns, decode_ns);
+	}
+
+	return sink == UINT32_MAX ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include "msg_codecs.h"
+
+static uint32_t rand_state = 1;
+
+void msg_rand_seed(uint32_t seed)
+{
+	rand_state = seed ? seed : 1;
+}
+
+uint32_t msg_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static void test_start_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_test_start_encode(buf, &msg->test_start);
+}
+
+static int test_start_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_test_start_decode(buf, &msg->test_start);
+}
+
+static void test_start_fill(union msg_any *msg)
+{
+	msg->test_start.duration = msg_rand();
+}
+
+static bool test_start_equal(const union msg_any *sent, const union msg_any *got)
+{
+	return sent->test_start.duration == got->test_start.duration;
+}
+
+static void test_result_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_test_result_encode(buf, &msg->test_result);
+}
+
+static int test_result_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_test_result_decode(buf, &msg->test_result);
+}
+
+static void test_result_fill(union msg_any *msg)
+{
+	msg->test_result.result = msg_rand() & 1;
+	msg->test_result.seq = msg_rand();
+	msg->test_result.vdd_mv = msg_rand();
+	msg->test_result.batt_mv = msg_rand();
+	/* Out of range delays are sent as LIGHT_DELAY_NONE */
+	msg->test_result.light_delay = msg_rand();
+}
+
+static bool test_result_equal(const union msg_any *sent, const union msg_any *got)
+{
+	const struct light_monitor_test_result *a = &sent->test_result;
+	const struct light_monitor_test_result *b = &got->test_result;
+
+	return a->result == b->result && a->seq == b->seq && a->vdd_mv == b->vdd_mv &&
+	       a->batt_mv == b->batt_mv && MIN(a->light_delay, LIGHT_DELAY_NONE) == b->light_delay;
+}
+
+static void calibrate_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_calibrate_encode(buf, &msg->calibrate);
+}
+
+static int calibrate_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_calibrate_decode(buf, &msg->calibrate);
+}
+
+static void calibrate_fill(union msg_any *msg)
+{
+	msg->calibrate.seq = msg_rand();
+	msg->calibrate.window = msg_rand();
+}
+
+static bool calibrate_equal(const union msg_any *sent, const union msg_any *got)
+{
+	return sent->calibrate.seq == got->calibrate.seq &&
+	       sent->calibrate.window == got->calibrate.window;
+}
+
+static void calibrate_status_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_calibrate_status_encode(buf, &msg->calibrate_status);
+}
+
+static int calibrate_status_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_calibrate_status_decode(buf, &msg->calibrate_status);
+}
+
+static void calibrate_status_fill(union msg_any *msg)
+{
+	msg->calibrate_status.seq = msg_rand();
+	msg->calibrate_status.threshold = msg_rand();
+	msg->calibrate_status.noise = msg_rand();
+}
+
+static bool calibrate_status_equal(const union msg_any *sent, const union msg_any *got)
+{
+	return sent->calibrate_status.seq == got->calibrate_status.seq &&
+	       sent->calibrate_status.threshold == got->calibrate_status.threshold &&
+	       sent->calibrate_status.noise == got->calibrate_status.noise;
+}
+
+static void result_ack_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_result_ack_encode(buf, msg->seq);
+}
+
+static int result_ack_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_result_ack_decode(buf, &msg->seq);
+}
+
+static void result_ack_fill(union msg_any *msg)
+{
+	msg->seq = msg_rand();
+}
+
+static bool result_ack_equal(const union msg_any *sent, const union msg_any *got)
+{
+	return sent->seq == got->seq;
+}
+
+static void status_update_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_status_update_encode(buf, &msg->status_update);
+}
+
+static int status_update_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_status_update_decode(buf, &msg->status_update);
+}
+
+static void status_update_fill(union msg_any *msg)
+{
+	msg->status_update.value = msg_rand();
+}
+
+static bool status_update_equal(const union msg_any *sent, const union msg_any *got)
+{
+	return sent->status_update.value == got->status_update.value;
+}
+
+static void result_log_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_result_log_encode(buf, &msg->result_log);
+}
+
+static int result_log_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_result_log_decode(buf, &msg->result_log);
+}
+
+static void result_log_fill(union msg_any *msg)
+{
+	uint32_t kind = msg_rand() % 4;
+
+	msg->result_log.result = msg_rand() & 1;
+	msg->result_log.reported = msg_rand() & 1;
+	/* Ages past the 24 bit field are clamped, the unknown age is kept */
+	msg->result_log.age = kind == 0 ? RESULT_LOG_AGE_UNKNOWN :
+			      kind == 1 ? msg_rand() :
+					  msg_rand() & RESULT_LOG_AGE_MAX;
+}
+
+static bool result_log_equal(const union msg_any *sent, const union msg_any *got)
+{
+	uint32_t age = sent->result_log.age == RESULT_LOG_AGE_UNKNOWN ?
+			       RESULT_LOG_AGE_UNKNOWN :
+			       MIN(sent->result_log.age, RESULT_LOG_AGE_MAX);
+
+	return sent->result_log.result == got->result_log.result &&
+	       sent->result_log.reported == got->result_log.reported && age == got->result_log.age;
+}
+
+static void test_progress_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_test_progress_encode(buf, &msg->test_progress);
+}
+
+static int test_progress_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_test_progress_decode(buf, &msg->test_progress);
+}
+
+static void test_progress_fill(union msg_any *msg)
+{
+	msg->test_progress.elapsed = msg_rand();
+	msg->test_progress.darkest = msg_rand();
+	msg->test_progress.current = msg_rand();
+	msg->test_progress.margin = msg_rand();
+}
+
+static bool test_progress_equal(const union msg_any *sent, const union msg_any *got)
+{
+	const struct light_monitor_test_progress *a = &sent->test_progress;
+	const struct light_monitor_test_progress *b = &got->test_progress;
+
+	return a->elapsed == b->elapsed && a->darkest == b->darkest && a->current == b->current &&
+	       a->margin == b->margin;
+}
+
+static void schedule_set_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_schedule_encode(buf, SCHEDULE_SET_OPCODE, &msg->schedule);
+}
+
+static void schedule_status_encode(struct net_buf_simple *buf, const union msg_any *msg)
+{
+	light_monitor_schedule_encode(buf, SCHEDULE_STATUS_OPCODE, &msg->schedule);
+}
+
+static int schedule_decode(struct net_buf_simple *buf, union msg_any *msg)
+{
+	return light_monitor_schedule_decode(buf, &msg->schedule);
+}
+
+static void schedule_fill(union msg_any *msg)
+{
+	msg->schedule.fn_period = msg_rand();
+	msg->schedule.fn_duration = msg_rand();
+	msg->schedule.full_period = msg_rand();
+	msg->schedule.full_duration = msg_rand();
+	msg->schedule.offset = msg_rand();
+}
+
+static bool schedule_equal(const union msg_any *sent, const union msg_any *got)
+{
+	const struct test_schedule *a = &sent->schedule;
+	const struct test_schedule *b = &got->schedule;
+
+	return a->fn_period == b->fn_period && a->fn_duration == b->fn_duration &&
+	       a->full_period == b->full_period && a->full_duration == b->full_duration &&
+	       a->offset == b->offset;
+}
+
+#define MSG_CODEC(_name, _opcode, _len, _encode, _prefix)                                          \
+	{                                                                                          \
+		.name = _name,                                                                     \
+		.opcode = _opcode,                                                                 \
+		.len = _len,                                                                       \
+		.encode = _encode,                                                                 \
+		.decode = _prefix##_decode,                                                        \
+		.fill = _prefix##_fill,                                                            \
+		.equal = _prefix##_equal,                                                          \
+	}
+
+const struct msg_codec msg_codecs[] = {
+	MSG_CODEC("test start", TEST_START_OPCODE, TEST_START_LEN, test_start_encode, test_start),
+	MSG_CODEC("test result", TEST_RESULT_OPCODE, TEST_RESULT_LEN, test_result_encode,
+		  test_result),
+	MSG_CODEC("calibrate", CALIBRATE_OPCODE, CALIBRATE_LEN, calibrate_encode, calibrate),
+	MSG_CODEC("calibrate ok", CALIBRATE_OK_OPCODE, CALIBRATE_OK_LEN, calibrate_status_encode,
+		  calibrate_status),
+	MSG_CODEC("result ack", RESULT_ACK_OPCODE, RESULT_ACK_LEN, result_ack_encode, result_ack),
+	MSG_CODEC("status update", UPDATE_STATUS_OPCODE, STATUS_UPDATE_LEN, status_update_encode,
+		  status_update),
+	MSG_CODEC("result log", RESULT_LOG_OPCODE, RESULT_LOG_LEN, result_log_encode, result_log),
+	MSG_CODEC("test progress", TEST_PROGRESS_OPCODE, TEST_PROGRESS_LEN, test_progress_encode,
+		  test_progress),
+	MSG_CODEC("schedule set", SCHEDULE_SET_OPCODE, SCHEDULE_SET_LEN, schedule_set_encode,
+		  schedule),
+	MSG_CODEC("schedule status", SCHEDULE_STATUS_OPCODE, SCHEDULE_STATUS_LEN,
+		  schedule_status_encode, schedule),
+};
+
+const size_t msg_codec_count = sizeof(msg_codecs) / sizeof(msg_codecs[0]);
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Every light monitor message with a payload, behind a common interface, so
+ * the round trip test, the fuzz target and the benchmark cover them all.
+ */
+
+#ifndef MSG_CODECS_H__
+#define MSG_CODECS_H__
+
+#include <stddef.h>
+#include "light_monitor_msg.h"
+
+/* Large enough for any of the message structs */
+union msg_any {
+	struct light_monitor_test_start test_start;
+	struct light_monitor_test_result test_result;
+	struct light_monitor_calibrate calibrate;
+	struct light_monitor_calibrate_status calibrate_status;
+	struct light_monitor_status_update status_update;
+	struct light_monitor_result_log result_log;
+	struct light_monitor_test_progress test_progress;
+	struct test_schedule schedule;
+	uint16_t seq;
+};
+
+struct msg_codec {
+	const char *name;
+	uint32_t opcode;
+	/* Payload length, without the opcode */
+	size_t len;
+	void (*encode)(struct net_buf_simple *buf, const union msg_any *msg);
+	int (*decode)(struct net_buf_simple *buf, union msg_any *msg);
+	/* Fill the message with random field values, in or out of range */
+	void (*fill)(union msg_any *msg);
+	/* Whether a decoded message matches the one that was encoded, after
+	 * the clamping the encoder does.
+	 */
+	bool (*equal)(const union msg_any *sent, const union msg_any *got);
+};
+
+extern const struct msg_codec msg_codecs[];
+extern const size_t msg_codec_count;
+
+/* Deterministic xorshift generator, so failures can be replayed */
+void msg_rand_seed(uint32_t seed);
+uint32_t msg_rand(void);
+
+#endif /* MSG_CODECS_H__ */
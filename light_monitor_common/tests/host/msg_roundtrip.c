@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Encodes random messages of every kind and checks that they decode to the
+ * same values, with the opcode and length the model layer expects.
+ */
+
+#include <string.h>
+#include "msg_codecs.h"
+
+#define ROUNDS 100000
+
+static int roundtrip(const struct msg_codec *codec)
+{
+	NET_BUF_SIMPLE_DEFINE(buf, BT_MESH_LIGHT_MONITOR_UNSEG_MAX);
+	union msg_any sent;
+	union msg_any got;
+	size_t op_len = BT_MESH_MODEL_OP_LEN(codec->opcode);
+
+	for (int i = 0; i < ROUNDS; i++) {
+		memset(&sent, 0, sizeof(sent));
+		memset(&got, 0, sizeof(got));
+		codec->fill(&sent);
+		codec->encode(&buf, &sent);
+
+		if (buf.len != op_len + codec->len) {
+			printf("%s: encoded %u bytes, expected %zu\n", codec->name, buf.len,
+			       op_len + codec->len);
+			return -1;
+		}
+
+		if (buf.data[0] != (uint8_t)(codec->opcode >> 16) ||
+		    (uint32_t)(buf.data[1] | buf.data[2] << 8) != (codec->opcode & 0xffff)) {
+			printf("%s: wrong opcode\n", codec->name);
+			return -1;
+		}
+
+		(void)net_buf_simple_pull(&buf, op_len);
+		if (codec->decode(&buf, &got) || buf.len != 0) {
+			printf("%s: decode failed, %u bytes left\n", codec->name, buf.len);
+			return -1;
+		}
+
+		if (!codec->equal(&sent, &got)) {
+			printf("%s: decoded message differs, round %d\n", codec->name, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(void)
+{
+	int failed = 0;
+
+	msg_rand_seed(0x4c4d);
+
+	for (size_t i = 0; i < msg_codec_count; i++) {
+		int err = roundtrip(&msg_codecs[i]);
+
+		printf("%-16s %s\n", msg_codecs[i].name, err ? "FAIL" : "ok");
+		failed += err != 0;
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Host stand-in for the parts of the Zephyr mesh and net_buf APIs the light
+ * monitor messages use. The buffer accessors abort on an overflow or an
+ * underflow, where Zephyr would assert.
+ */
+
+#ifndef HOST_STUB_BT_MESH_H__
+#define HOST_STUB_BT_MESH_H__
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BIT(n) (1UL << (n))
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define BUILD_ASSERT(expr, msg) _Static_assert(expr, msg)
+
+#define BT_MESH_MODEL_OP_1(b0) (b0)
+#define BT_MESH_MODEL_OP_2(b0, b1) (((b0) << 8) | (b1))
+#define BT_MESH_MODEL_OP_3(b0, cid) ((((b0) << 16) | 0xc00000) | (cid))
+#define BT_MESH_MODEL_OP_LEN(op) ((op) <= 0xff ? 1 : (op) <= 0xffff ? 2 : 3)
+
+struct net_buf_simple {
+	uint8_t *data;
+	uint16_t len;
+	uint16_t size;
+	uint8_t *__buf;
+};
+
+#define NET_BUF_SIMPLE_DEFINE(_name, _size)                                                        \
+	uint8_t net_buf_data_##_name[_size];                                                       \
+	struct net_buf_simple _name = {                                                            \
+		.data = net_buf_data_##_name,                                                      \
+		.len = 0,                                                                          \
+		.size = _size,                                                                     \
+		.__buf = net_buf_data_##_name,                                                     \
+	}
+
+static inline void net_buf_simple_check(bool ok, const char *what)
+{
+	if (!ok) {
+		fprintf(stderr, "net_buf_simple %s out of bounds\n", what);
+		abort();
+	}
+}
+
+static inline void net_buf_simple_init_with_data(struct net_buf_simple *buf, void *data,
+						 size_t size)
+{
+	buf->__buf = data;
+	buf->data = data;
+	buf->size = size;
+	buf->len = size;
+}
+
+static inline void net_buf_simple_reset(struct net_buf_simple *buf)
+{
+	buf->len = 0;
+	buf->data = buf->__buf;
+}
+
+static inline uint8_t *net_buf_simple_add(struct net_buf_simple *buf, size_t len)
+{
+	uint8_t *tail = buf->data + buf->len;
+
+	net_buf_simple_check(tail + len <= buf->__buf + buf->size, "add");
+	buf->len += len;
+	return tail;
+}
+
+static inline void net_buf_simple_add_u8(struct net_buf_simple *buf, uint8_t val)
+{
+	*net_buf_simple_add(buf, 1) = val;
+}
+
+static inline void net_buf_simple_add_le16(struct net_buf_simple *buf, uint16_t val)
+{
+	uint8_t *p = net_buf_simple_add(buf, 2);
+
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static inline void net_buf_simple_add_le24(struct net_buf_simple *buf, uint32_t val)
+{
+	uint8_t *p = net_buf_simple_add(buf, 3);
+
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+}
+
+static inline uint8_t *net_buf_simple_pull(struct net_buf_simple *buf, size_t len)
+{
+	uint8_t *head = buf->data;
+
+	net_buf_simple_check(len <= buf->len, "pull");
+	buf->len -= len;
+	buf->data += len;
+	return head;
+}
+
+static inline uint8_t net_buf_simple_pull_u8(struct net_buf_simple *buf)
+{
+	return *net_buf_simple_pull(buf, 1);
+}
+
+static inline uint16_t net_buf_simple_pull_le16(struct net_buf_simple *buf)
+{
+	uint8_t *p = net_buf_simple_pull(buf, 2);
+
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t net_buf_simple_pull_le24(struct net_buf_simple *buf)
+{
+	uint8_t *p = net_buf_simple_pull(buf, 3);
+
+	return p[0] | p[1] << 8 | (uint32_t)p[2] << 16;
+}
+
+static inline void bt_mesh_model_msg_init(struct net_buf_simple *msg, uint32_t opcode)
+{
+	net_buf_simple_reset(msg);
+
+	switch (BT_MESH_MODEL_OP_LEN(opcode)) {
+	case 1:
+		net_buf_simple_add_u8(msg, opcode);
+		break;
+	case 2:
+		net_buf_simple_add_u8(msg, opcode >> 8);
+		net_buf_simple_add_u8(msg, opcode);
+		break;
+	default:
+		net_buf_simple_add_u8(msg, opcode >> 16);
+		net_buf_simple_add_le16(msg, opcode & 0xffff);
+		break;
+	}
+}
+
+#endif /* HOST_STUB_BT_MESH_H__ */
@@ -14,55 +14,20 @@
 #ifndef BT_MESH_LIGHT_MONITOR_srv_H__
 #define BT_MESH_LIGHT_MONITOR_srv_H__
 
+#include <zephyr/kernel.h>
 #include <zephyr/bluetooth/mesh.h>
 #include <bluetooth/mesh/model_types.h>
 #include <bluetooth/mesh/sensor_srv.h>
+#include "light_monitor_msg.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID 0x0059
 #define BT_MESH_LIGHT_MONITOR_VENDOR_MODEL_ID 0x000B
 
 #define BT_MESH_LIGHT_MONITOR_SETUP_VENDOR_MODEL_ID 0x000C
 
-#define GET_STATUS_OPCODE BT_MESH_MODEL_OP_3(0x01, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_ACK_OPCODE BT_MESH_MODEL_OP_3(0x02, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_RESULT_OPCODE BT_MESH_MODEL_OP_3(0x03, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define UPDATE_STATUS_OPCODE BT_MESH_MODEL_OP_3(0x04, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define TEST_START_OPCODE BT_MESH_MODEL_OP_3(0x05, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define RESULT_LOGG_OPCODE BT_MESH_MODEL_OP_3(0x06, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_LOG_OPCODE BT_MESH_MODEL_OP_3(0x07, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_ACK_OPCODE BT_MESH_MODEL_OP_3(0x08, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_START_OPCODE BT_MESH_MODEL_OP_3(0x09, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_RESULT_OPCODE BT_MESH_MODEL_OP_3(0x0A, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define GET_TEST_START_OPCODE BT_MESH_MODEL_OP_3(0x0B, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-
-#define CALIBRATE_OPCODE BT_MESH_MODEL_OP_3(0x0C, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-#define CALIBRATE_OK_OPCODE BT_MESH_MODEL_OP_3(0x0D, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-
-/** Non-private message opcode. */
-#define BT_MESH_LIGHT_MONITOR_OP_MESSAGE                                                           \
-	BT_MESH_MODEL_OP_3(0x0A, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-
-/** Message reply opcode. */
-#define BT_MESH_LIGHT_MONITOR_OP_MESSAGE_REPLY                                                     \
-	BT_MESH_MODEL_OP_3(0x0C, BT_MESH_LIGHT_MONITOR_VENDOR_COMPANY_ID)
-
-#define GET_STATUS_LEN 0
-#define TEST_ACK_LEN 0
-#define TEST_RESULT_LEN 1
-#define STATUS_UPDATE_LEN 2
-#define TEST_START_LEN 1
-#define GET_LOG_LEN 0
-#define RESULT_LOGG_LEN 5
-#define GET_ACK_LEN 0
-#define GET_START_LEN 0
-#define GET_RESULT_LEN 0
-
-#define CALIBRATE_LEN 0
-
 #define BT_MESH_LIGHT_MONITOR_MSG_MINLEN_MESSAGE 1
 #define BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE                                                   \
 	(CONFIG_BT_MESH_LIGHT_MONITOR_MESSAGE_LENGTH + 1) /* + \0 */
@@ -112,10 +77,9 @@ struct bt_light_monitor_handlers {
      * @param[in] monitor Light Monitor instance that received the test message.
      * @param[in] ctx Context of the incoming message.
      * @param[in] duration The duration for which the test will run in seconds.
-     * @param[in] time_stamp The timestamp of when the test start message was sent.
      */
 	void (*const test)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-			   uint16_t duration, uint32_t time_stamp);
+			   uint16_t duration);
 
 	/** @brief Handler for a result.
      *
@@ -169,12 +133,44 @@ struct bt_light_monitor_setup_handlers {
      *
      * @param[in] monitor Light Monitor instance that received the calibrate message.
      * @param[in] ctx Context of the incoming message.
+     * @param[in] msg Calibration round and reply window.
+     */
+	void (*const calibrate)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+				const struct light_monitor_calibrate *msg);
+
+	/** @brief Handler for a new test schedule.
+     *
+     * Also called with a NULL context when a stored schedule has been loaded.
+     *
+     * @param[in] monitor Light Monitor instance that received the schedule.
+     * @param[in] ctx Context of the incoming message.
+     * @param[in] schedule The new test schedule.
      */
-	void (*const calibrate)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx);
+	void (*const schedule)(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+			       const struct test_schedule *schedule);
+};
+
+/** Priority of outgoing messages, highest first. */
+enum bt_mesh_light_monitor_tx_prio {
+	LIGHT_MONITOR_TX_PRIO_RESULT,
+	LIGHT_MONITOR_TX_PRIO_ACK,
+	LIGHT_MONITOR_TX_PRIO_CALIBRATION,
+	LIGHT_MONITOR_TX_PRIO_LOG,
+	LIGHT_MONITOR_TX_PRIO_STATUS,
+
+	LIGHT_MONITOR_TX_PRIO_COUNT,
 };
 
 struct test_result {
 	bool result;
+	/* Whether the node had the network time when the test started. If not,
+	 * the timestamp is in seconds since boot and only marks the entry as used.
+	 */
+	bool synced;
+	/* Whether the gateway acknowledged the result. It then has the result
+	 * itself, and doesn't file the entry again when the log is harvested.
+	 */
+	bool reported;
 	uint32_t time_stamp;
 };
 
@@ -195,8 +191,8 @@ struct bt_mesh_light_monitor {
 	/** Publication message. */
 	struct net_buf_simple pub_msg;
 	/** Publication message buffer. */
-	uint16_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
-					   BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
+	uint8_t buf[BT_MESH_MODEL_BUF_LEN(UPDATE_STATUS_OPCODE,
+					  BT_MESH_LIGHT_MONITOR_MSG_MAXLEN_MESSAGE)];
 	/** Handler function structure. */
 
 	const struct bt_light_monitor_handlers *handlers;
@@ -204,24 +200,65 @@ struct bt_mesh_light_monitor {
 	const struct bt_light_monitor_setup_handlers *setup_handlers;
 	struct results_store res_sto;
 
+	/** Setup model pointer. */
+	struct bt_mesh_model *setup_model;
+	/** Autonomous test schedule. */
+	struct test_schedule schedule;
 	struct bt_mesh_model_pub setup_pub;
 	/* Publication buffer */
 	struct net_buf_simple setup_pub_buf;
 	/* Publication data */
+	uint8_t setup_buf[BT_MESH_MODEL_BUF_LEN(SCHEDULE_STATUS_OPCODE, SCHEDULE_STATUS_LEN)];
+
+	/** Outgoing messages waiting for the publication buffer, per priority. */
+	sys_slist_t tx_queue[LIGHT_MONITOR_TX_PRIO_COUNT];
+	/** Protects the send queues. */
+	struct k_spinlock tx_lock;
+	/** Publishes the queued messages one at a time. */
+	struct k_work_delayable tx_work;
+
+	/** Retransmission of the last result until it is acknowledged. */
+	struct k_work_delayable result_retx;
+	/** Stores the results once the last one is acknowledged. */
+	struct k_work result_store;
+	/** Sequence number of the last result. */
+	uint16_t result_seq;
+	/** Number of times the last result has been sent. */
+	uint8_t result_attempts;
+	/** Whether the last result is still waiting for its acknowledgement. */
+	bool result_pending;
+	/** Value of the last result. */
+	bool result_value;
+	/** Lowest supply voltage during the last test, in millivolts. */
+	uint16_t result_vdd_mv;
+	/** Lowest battery voltage during the last test, in millivolts. */
+	int16_t result_batt_mv;
+	/** Time the light took to come on in the last test, in units of LIGHT_DELAY_UNIT_US. */
+	uint16_t result_light_delay;
 };
 
 extern int send_sensor_update(struct bt_mesh_light_monitor *monitor, uint16_t sample_value);
+extern int send_test_progress(struct bt_mesh_light_monitor *monitor,
+			      const struct light_monitor_test_progress *progress);
 extern int set_light_test_start(struct bt_mesh_light_monitor *monitor, uint16_t test_duration,
 				uint32_t time_stamp);
 extern int send_test_ack(struct bt_mesh_light_monitor *monitor);
-extern int send_test_result(struct bt_mesh_light_monitor *monitor, bool result);
+extern int send_test_result(struct bt_mesh_light_monitor *monitor, bool result, uint16_t vdd_mv,
+			    int16_t batt_mv, uint16_t light_delay);
+extern int resend_test_result(struct bt_mesh_light_monitor *monitor);
+/** Retransmit a pending result if its ack is not delivered by the friend poll
+ *  that just happened. Only used by a Low Power Node.
+ */
+extern void result_retx_on_poll(struct bt_mesh_light_monitor *monitor);
+extern int store_test_results(struct bt_mesh_light_monitor *monitor);
 extern int handle_get_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
 			     struct net_buf_simple *buf);
 extern int get_status(struct bt_mesh_light_monitor *monitor);
-extern int send_logged_result(struct bt_mesh_light_monitor *monitor, uint32_t time_stamp,
-			      bool result);
+extern int send_logged_result(struct bt_mesh_light_monitor *monitor, uint32_t age,
+			      bool result, bool reported);
 extern int get_test_start(struct bt_mesh_light_monitor *monitor);
-extern int send_calibrated_ok(struct bt_mesh_light_monitor *monitor);
+extern int send_calibrated_ok(struct bt_mesh_light_monitor *monitor,
+			      const struct light_monitor_calibrate_status *status);
 
 /** @cond INTERNAL_HIDDEN */
 extern const struct bt_mesh_model_op _bt_mesh_light_monitor_op[];
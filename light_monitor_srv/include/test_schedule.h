@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/**
+ * @file
+ * @brief Autonomous test scheduling
+ *
+ * Runs the periodic functional and full duration tests on the node itself,
+ * so a campaign doesn't depend on the host being up. The tests are due by the
+ * network time, and the time of the last test of each kind is stored, so a
+ * reboot doesn't restart the schedule. Without the network time no test is
+ * started.
+ */
+
+#ifndef TEST_SCHEDULE_H__
+#define TEST_SCHEDULE_H__
+
+#include "light_monitor_srv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Callback starting a scheduled test.
+ *
+ * @param[in] duration Test duration in seconds.
+ *
+ * @return true if the test was started, false if the node is busy.
+ */
+typedef bool (*test_schedule_run_t)(uint16_t duration);
+
+/** @brief Callback getting the network time.
+ *
+ * @return Unix time, or 0 if the node doesn't have the network time.
+ */
+typedef uint32_t (*test_schedule_time_t)(void);
+
+/** @brief Initialize the test scheduler.
+ *
+ * @param[in] run Callback starting a scheduled test.
+ * @param[in] time Callback getting the network time.
+ */
+void test_schedule_init(test_schedule_run_t run, test_schedule_time_t time);
+
+/** @brief Apply a new test schedule.
+ *
+ * The offset of the schedule counts from the moment it is applied, or from
+ * the moment the node gets the network time. Applying the running schedule
+ * again changes nothing.
+ *
+ * @param[in] schedule Test schedule, all periods 0 to stop scheduling.
+ */
+void test_schedule_set(const struct test_schedule *schedule);
+
+/** @brief Resume the stored test schedule after a reboot.
+ *
+ * Tests that became due while the node was off are started once the offset
+ * of the schedule has elapsed.
+ *
+ * @param[in] schedule Stored test schedule.
+ */
+void test_schedule_resume(const struct test_schedule *schedule);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TEST_SCHEDULE_H__ */
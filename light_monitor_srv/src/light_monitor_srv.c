@@ -6,12 +6,15 @@
 
 #include <zephyr/bluetooth/mesh.h>
 #include "light_monitor_srv.h"
+#include "light_monitor_workq.h"
 #include "mesh/net.h"
 #include <string.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/random/rand32.h>
 #include <bluetooth/mesh/sensor_srv.h>
 
-uint8_t err;
+/* Sends and retransmissions have their own queue, host output never delays them */
+#define REPLY_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
 
 extern int handle_get_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
 			     struct net_buf_simple *buf)
@@ -27,14 +30,17 @@ extern int handle_get_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx
 static int handle_light_test_start(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
 				   struct net_buf_simple *buf)
 {
-	uint16_t test_duration;
-	uint32_t time_stamp;
-	test_duration = net_buf_simple_pull_le16(buf);
-	time_stamp = net_buf_simple_pull_le32(buf);
 	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct light_monitor_test_start msg;
+	int err;
+
+	err = light_monitor_test_start_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
 
 	if (monitor->handlers->test) {
-		monitor->handlers->test(monitor, ctx, test_duration, time_stamp);
+		monitor->handlers->test(monitor, ctx, msg.duration);
 	}
 	return 0;
 }
@@ -69,102 +75,388 @@ static int handle_result_get(struct bt_mesh_model *model, struct bt_mesh_msg_ctx
 	return 0;
 }
 
+static int handle_result_ack(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+			     struct net_buf_simple *buf)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+	uint16_t seq;
+	int err;
+
+	err = light_monitor_result_ack_decode(buf, &seq);
+	if (err) {
+		return err;
+	}
+
+	if (monitor->result_pending && seq == monitor->result_seq) {
+		monitor->result_pending = false;
+		monitor->res_sto.results[monitor->res_sto.last_result_idx].reported = true;
+		k_work_cancel_delayable(&monitor->result_retx);
+		/* Kept over a reboot, so the entry isn't filed twice later on */
+		k_work_submit_to_queue(REPLY_WQ, &monitor->result_store);
+	}
+	return 0;
+}
+
 static int handle_calibrate(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
 			    struct net_buf_simple *buf)
 {
-	printk("calibrating\n");
 	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct light_monitor_calibrate msg;
+	int err;
+
+	err = light_monitor_calibrate_decode(buf, &msg);
+	if (err) {
+		return err;
+	}
+
+	printk("calibrating\n");
 	if (monitor->setup_handlers->calibrate) {
-		monitor->setup_handlers->calibrate(monitor, ctx);
+		monitor->setup_handlers->calibrate(monitor, ctx, &msg);
 	}
 	return 0;
 }
 
+static int send_schedule_status(struct bt_mesh_light_monitor *monitor,
+				struct bt_mesh_msg_ctx *ctx)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, SCHEDULE_STATUS_OPCODE, SCHEDULE_STATUS_LEN);
+
+	light_monitor_schedule_encode(&buf, SCHEDULE_STATUS_OPCODE, &monitor->schedule);
+
+	return bt_mesh_model_send(monitor->setup_model, ctx, &buf, NULL, NULL);
+}
+
+static int handle_schedule_set(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx,
+			       struct net_buf_simple *buf)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+	struct test_schedule schedule;
+
+	if (light_monitor_schedule_decode(buf, &schedule)) {
+		return -EMSGSIZE;
+	}
+
+	monitor->schedule = schedule;
+
+	if (IS_ENABLED(CONFIG_BT_SETTINGS) &&
+	    bt_mesh_model_data_store(monitor->setup_model, true, NULL, &monitor->schedule,
+				     sizeof(monitor->schedule))) {
+		printk("Storing the test schedule failed\n");
+	}
+
+	if (monitor->setup_handlers->schedule) {
+		monitor->setup_handlers->schedule(monitor, ctx, &monitor->schedule);
+	}
+
+	return send_schedule_status(monitor, ctx);
+}
+
 const struct bt_mesh_model_op _bt_mesh_light_monitor_op[] = {
 	{ GET_STATUS_OPCODE, GET_STATUS_LEN, handle_get_status },
 	{ TEST_START_OPCODE, TEST_START_LEN, handle_light_test_start },
 	{ GET_LOG_OPCODE, GET_LOG_LEN, handle_log_get },
 	{ GET_ACK_OPCODE, GET_ACK_LEN, handle_ack_get },
 	{ GET_RESULT_OPCODE, GET_RESULT_LEN, handle_result_get },
+	{ RESULT_ACK_OPCODE, RESULT_ACK_LEN, handle_result_ack },
 
 	BT_MESH_MODEL_OP_END,
 };
 
 const struct bt_mesh_model_op _bt_mesh_light_monitor_setup_op[] = {
 	{ CALIBRATE_OPCODE, CALIBRATE_LEN, handle_calibrate },
-	
+	{ SCHEDULE_SET_OPCODE, SCHEDULE_SET_LEN, handle_schedule_set },
+
 	BT_MESH_MODEL_OP_END,
 };
 
-uint16_t msg;
-bool result_msg;
-uint32_t time_stamp;
-extern int send_sensor_update(struct bt_mesh_light_monitor *monitor, uint16_t update_value)
+/* Every outgoing message is encoded into a buffer from this pool and queued by
+ * priority. The queue is drained into the single publication buffer one
+ * message at a time, so concurrent senders don't overwrite each other.
+ */
+struct light_monitor_tx {
+	sys_snode_t node;
+	uint8_t len;
+	uint8_t data[BT_MESH_LIGHT_MONITOR_UNSEG_MAX];
+};
+
+/* Buffers only results and acks may take */
+#define TX_RESERVED_BUFS 2
+/* Retry interval while the mesh stack is out of advertising buffers */
+#define TX_RETRY_MS 20
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, sizeof(struct light_monitor_tx),
+			 CONFIG_BT_MESH_LIGHT_MONITOR_TX_BUF_COUNT, 4);
+
+static int tx_enqueue(struct bt_mesh_light_monitor *monitor,
+		      enum bt_mesh_light_monitor_tx_prio prio, struct net_buf_simple *buf)
 {
-	msg = update_value;
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	struct light_monitor_tx *tx;
+	k_spinlock_key_t key;
 
-	bt_mesh_model_msg_init(buf, UPDATE_STATUS_OPCODE);
-	net_buf_simple_add_le16(buf, msg);
+	if (prio > LIGHT_MONITOR_TX_PRIO_ACK &&
+	    k_mem_slab_num_free_get(&tx_slab) <= TX_RESERVED_BUFS) {
+		return -ENOBUFS;
+	}
+
+	if (k_mem_slab_alloc(&tx_slab, (void **)&tx, K_NO_WAIT)) {
+		return -ENOBUFS;
+	}
+
+	tx->len = buf->len;
+	memcpy(tx->data, buf->data, buf->len);
+
+	key = k_spin_lock(&monitor->tx_lock);
+	sys_slist_append(&monitor->tx_queue[prio], &tx->node);
+	k_spin_unlock(&monitor->tx_lock, key);
+
+	k_work_schedule_for_queue(REPLY_WQ, &monitor->tx_work, K_NO_WAIT);
 
-	return bt_mesh_model_publish(monitor->model);
+	return 0;
 }
 
-extern int send_test_result(struct bt_mesh_light_monitor *monitor, bool result)
+static struct light_monitor_tx *tx_peek(struct bt_mesh_light_monitor *monitor)
 {
-	result_msg = result;
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	struct light_monitor_tx *tx = NULL;
+	k_spinlock_key_t key = k_spin_lock(&monitor->tx_lock);
 
-	bt_mesh_model_msg_init(buf, TEST_RESULT_OPCODE);
-	net_buf_simple_add_mem(buf, &result_msg, TEST_RESULT_LEN);
-	if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
-		err = bt_mesh_model_data_store(monitor->model, true, NULL, &monitor->res_sto,
-					       sizeof(monitor->res_sto));
+	for (int i = 0; i < ARRAY_SIZE(monitor->tx_queue) && !tx; i++) {
+		tx = SYS_SLIST_PEEK_HEAD_CONTAINER(&monitor->tx_queue[i], tx, node);
 	}
 
-	return bt_mesh_model_publish(monitor->model);
+	k_spin_unlock(&monitor->tx_lock, key);
+
+	return tx;
 }
 
-extern int send_logged_result(struct bt_mesh_light_monitor *monitor, uint32_t time_stamp,
-			      bool result)
+static void tx_free(struct bt_mesh_light_monitor *monitor, struct light_monitor_tx *tx)
 {
-	result_msg = result;
-	time_stamp = time_stamp;
+	k_spinlock_key_t key = k_spin_lock(&monitor->tx_lock);
+
+	for (int i = 0; i < ARRAY_SIZE(monitor->tx_queue); i++) {
+		if (sys_slist_find_and_remove(&monitor->tx_queue[i], &tx->node)) {
+			break;
+		}
+	}
+
+	k_spin_unlock(&monitor->tx_lock, key);
+	k_mem_slab_free(&tx_slab, tx);
+}
+
+static void tx_work_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct bt_mesh_light_monitor *monitor =
+		CONTAINER_OF(dwork, struct bt_mesh_light_monitor, tx_work);
 	struct net_buf_simple *buf = monitor->model->pub->msg;
-	printk("Sendt logged result is %u and time is %d \n", result_msg, time_stamp);
+	struct light_monitor_tx *tx;
+	int err;
+
+	/* Publish retransmissions are sent from the publication buffer, so it
+	 * can't be reused before they are done.
+	 */
+	if (monitor->pub.count) {
+		k_work_reschedule_for_queue(REPLY_WQ, &monitor->tx_work, K_MSEC(TX_RETRY_MS));
+		return;
+	}
+
+	tx = tx_peek(monitor);
+	if (!tx) {
+		return;
+	}
+
+	net_buf_simple_reset(buf);
+	net_buf_simple_add_mem(buf, tx->data, tx->len);
+
+	err = bt_mesh_model_publish(monitor->model);
+	if (err == -ENOBUFS) {
+		k_work_reschedule_for_queue(REPLY_WQ, &monitor->tx_work, K_MSEC(TX_RETRY_MS));
+		return;
+	}
+
+	if (err) {
+		printk("Publishing failed (err %d)\n", err);
+	}
+
+	tx_free(monitor, tx);
+	k_work_reschedule_for_queue(REPLY_WQ, &monitor->tx_work, K_NO_WAIT);
+}
+
+extern int send_sensor_update(struct bt_mesh_light_monitor *monitor, uint16_t update_value)
+{
+	struct light_monitor_status_update msg = { .value = update_value };
+	BT_MESH_MODEL_BUF_DEFINE(buf, UPDATE_STATUS_OPCODE, STATUS_UPDATE_LEN);
+
+	light_monitor_status_update_encode(&buf, &msg);
+
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_STATUS, &buf);
+}
+
+extern int send_test_progress(struct bt_mesh_light_monitor *monitor,
+			      const struct light_monitor_test_progress *progress)
+{
+	BT_MESH_MODEL_BUF_DEFINE(buf, TEST_PROGRESS_OPCODE, TEST_PROGRESS_LEN);
+
+	light_monitor_test_progress_encode(&buf, progress);
+
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_STATUS, &buf);
+}
+
+static int publish_test_result(struct bt_mesh_light_monitor *monitor)
+{
+	struct light_monitor_test_result msg = {
+		.result = monitor->result_value,
+		.seq = monitor->result_seq,
+		.vdd_mv = monitor->result_vdd_mv,
+		.batt_mv = monitor->result_batt_mv,
+		.light_delay = monitor->result_light_delay,
+	};
+	BT_MESH_MODEL_BUF_DEFINE(buf, TEST_RESULT_OPCODE, TEST_RESULT_LEN);
+
+	light_monitor_test_result_encode(&buf, &msg);
+
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_RESULT, &buf);
+}
+
+/* Exponential backoff with up to 50% random jitter */
+static k_timeout_t result_retx_delay(uint8_t attempts)
+{
+	uint32_t delay = CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_RETX_BASE_MS << MIN(attempts, 16);
+
+	delay = MIN(delay, CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_RETX_MAX_MS);
 
-	bt_mesh_model_msg_init(buf, RESULT_LOGG_OPCODE);
-	net_buf_simple_add_mem(buf, &result_msg, 1);
-	net_buf_simple_add_le32(buf, time_stamp);
+	return K_MSEC(delay + sys_rand32_get() % (delay / 2 + 1));
+}
+
+static void result_retx_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct bt_mesh_light_monitor *monitor =
+		CONTAINER_OF(dwork, struct bt_mesh_light_monitor, result_retx);
+
+	if (!monitor->result_pending) {
+		return;
+	}
+
+	(void)publish_test_result(monitor);
+
+	if (++monitor->result_attempts >= CONFIG_BT_MESH_LIGHT_MONITOR_RESULT_RETX_COUNT) {
+		/* Give up, the client polls the nodes it hasn't heard from */
+		monitor->result_pending = false;
+		return;
+	}
+
+	if (IS_ENABLED(CONFIG_BT_MESH_LOW_POWER)) {
+		/* The ack waits on the friend, the next poll decides on a retransmission */
+		return;
+	}
+
+	k_work_reschedule_for_queue(REPLY_WQ, &monitor->result_retx,
+				    result_retx_delay(monitor->result_attempts));
+}
+
+extern int store_test_results(struct bt_mesh_light_monitor *monitor)
+{
+	if (!IS_ENABLED(CONFIG_BT_SETTINGS)) {
+		return 0;
+	}
+
+	return bt_mesh_model_data_store(monitor->model, true, NULL, &monitor->res_sto,
+					sizeof(monitor->res_sto));
+}
+
+static void result_store_handler(struct k_work *work)
+{
+	struct bt_mesh_light_monitor *monitor =
+		CONTAINER_OF(work, struct bt_mesh_light_monitor, result_store);
+	int err;
+
+	err = store_test_results(monitor);
+	if (err) {
+		printk("Storing the acknowledged result failed (err %d)\n", err);
+	}
+}
+
+extern int send_test_result(struct bt_mesh_light_monitor *monitor, bool result, uint16_t vdd_mv,
+			    int16_t batt_mv, uint16_t light_delay)
+{
+	int err;
+
+	err = store_test_results(monitor);
+	if (err) {
+		printk("Storing the result failed (err %d)\n", err);
+	}
+
+	monitor->result_value = result;
+	monitor->result_vdd_mv = vdd_mv;
+	monitor->result_batt_mv = batt_mv;
+	monitor->result_light_delay = light_delay;
+	monitor->result_seq++;
+	monitor->result_attempts = 0;
+	monitor->result_pending = true;
+
+	/* The first attempt is jittered too, as every node of a wave finishes at the same time */
+	k_work_reschedule_for_queue(REPLY_WQ, &monitor->result_retx, result_retx_delay(0));
+
+	return 0;
+}
+
+extern int resend_test_result(struct bt_mesh_light_monitor *monitor)
+{
+	return publish_test_result(monitor);
+}
+
+#ifdef CONFIG_BT_MESH_LOW_POWER
+extern void result_retx_on_poll(struct bt_mesh_light_monitor *monitor)
+{
+	if (monitor->result_pending) {
+		k_work_reschedule_for_queue(REPLY_WQ, &monitor->result_retx,
+					    K_MSEC(CONFIG_BT_MESH_LIGHT_MONITOR_LPN_ACK_WAIT_MS));
+	}
+}
+#endif
+
+extern int send_logged_result(struct bt_mesh_light_monitor *monitor, uint32_t age,
+			      bool result, bool reported)
+{
+	struct light_monitor_result_log msg = {
+		.result = result,
+		.reported = reported,
+		.age = age,
+	};
+	BT_MESH_MODEL_BUF_DEFINE(buf, RESULT_LOG_OPCODE, RESULT_LOG_LEN);
+
+	printk("Sendt logged result is %u and age is %u min \n", result, age);
+	light_monitor_result_log_encode(&buf, &msg);
 
-	return bt_mesh_model_publish(monitor->model);
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_LOG, &buf);
 }
 
 extern int get_test_start(struct bt_mesh_light_monitor *monitor)
 {
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	BT_MESH_MODEL_BUF_DEFINE(buf, GET_START_OPCODE, GET_START_LEN);
 
-	bt_mesh_model_msg_init(buf, GET_START_OPCODE);
+	bt_mesh_model_msg_init(&buf, GET_START_OPCODE);
 
-	return bt_mesh_model_publish(monitor->model);
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_ACK, &buf);
 }
 
 extern int send_test_ack(struct bt_mesh_light_monitor *monitor)
 {
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	BT_MESH_MODEL_BUF_DEFINE(buf, TEST_ACK_OPCODE, TEST_ACK_LEN);
 
-	bt_mesh_model_msg_init(buf, TEST_ACK_OPCODE);
+	bt_mesh_model_msg_init(&buf, TEST_ACK_OPCODE);
 
-	return bt_mesh_model_publish(monitor->model);
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_ACK, &buf);
 }
 
-extern int send_calibrated_ok(struct bt_mesh_light_monitor *monitor)
+extern int send_calibrated_ok(struct bt_mesh_light_monitor *monitor,
+			      const struct light_monitor_calibrate_status *status)
 {
-	struct net_buf_simple *buf = monitor->model->pub->msg;
+	BT_MESH_MODEL_BUF_DEFINE(buf, CALIBRATE_OK_OPCODE, CALIBRATE_OK_LEN);
 
-	bt_mesh_model_msg_init(buf, CALIBRATE_OK_OPCODE);
+	light_monitor_calibrate_status_encode(&buf, status);
 
-	return bt_mesh_model_publish(monitor->model);
+	return tx_enqueue(monitor, LIGHT_MONITOR_TX_PRIO_CALIBRATION, &buf);
 }
 
 static int bt_mesh_light_monitor_update_handler(struct bt_mesh_model *model)
@@ -202,29 +494,89 @@ static int bt_mesh_light_monitor_init(struct bt_mesh_model *model)
 	monitor->model = model;
 	monitor->setup_pub.msg = &monitor->setup_pub_buf;
 
-	net_buf_simple_init_with_data(&monitor->setup_pub_buf, monitor->buf,
-				      sizeof(monitor->setup_pub_buf));
+	net_buf_simple_init_with_data(&monitor->setup_pub_buf, monitor->setup_buf,
+				      sizeof(monitor->setup_buf));
 
 	net_buf_simple_init_with_data(&monitor->pub_msg, monitor->buf, sizeof(monitor->buf));
 	monitor->pub.msg = &monitor->pub_msg;
 	monitor->pub.update = bt_mesh_light_monitor_update_handler;
+	k_work_init_delayable(&monitor->result_retx, result_retx_handler);
+	k_work_init(&monitor->result_store, result_store_handler);
+	k_work_init_delayable(&monitor->tx_work, tx_work_handler);
+	for (int i = 0; i < ARRAY_SIZE(monitor->tx_queue); i++) {
+		sys_slist_init(&monitor->tx_queue[i]);
+	}
+
+	return 0;
+}
+
+static int bt_mesh_light_monitor_start(struct bt_mesh_model *model)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+
+	if (monitor->handlers->start) {
+		monitor->handlers->start(monitor);
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_BT_SETTINGS
+static int bt_mesh_light_monitor_setup_settings_set(struct bt_mesh_model *model, const char *name,
+						    size_t len_rd, settings_read_cb read_cb,
+						    void *cb_arg)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+
+	if (name) {
+		return -ENOENT;
+	}
+	ssize_t bytes = read_cb(cb_arg, &monitor->schedule, sizeof(monitor->schedule));
+
+	if (bytes < 0) {
+		return bytes;
+	}
+
+	if (bytes != 0 && bytes != sizeof(monitor->schedule)) {
+		return -EINVAL;
+	}
 
 	return 0;
 }
+#endif
 
 static int bt_mesh_light_monitor_setup_init(struct bt_mesh_model *model)
 {
 	struct bt_mesh_light_monitor *monitor_setup = model->user_data;
 
+	monitor_setup->setup_model = model;
+
 	return bt_mesh_model_extend(model, monitor_setup->model);
 }
 
+static int bt_mesh_light_monitor_setup_start(struct bt_mesh_model *model)
+{
+	struct bt_mesh_light_monitor *monitor = model->user_data;
+
+	/* Resume the stored schedule after a reboot */
+	if (monitor->setup_handlers->schedule) {
+		monitor->setup_handlers->schedule(monitor, NULL, &monitor->schedule);
+	}
+
+	return 0;
+}
+
 const struct bt_mesh_model_cb _bt_mesh_light_monitor_setup_cb = {
 	.init = bt_mesh_light_monitor_setup_init,
+	.start = bt_mesh_light_monitor_setup_start,
+#ifdef CONFIG_BT_SETTINGS
+	.settings_set = bt_mesh_light_monitor_setup_settings_set,
+#endif
 };
 
 const struct bt_mesh_model_cb _bt_mesh_light_monitor_cb = {
 	.init = bt_mesh_light_monitor_init,
+	.start = bt_mesh_light_monitor_start,
 #ifdef CONFIG_BT_SETTINGS
 	.settings_set = bt_mesh_light_monitor_srv_settings_set,
 #endif
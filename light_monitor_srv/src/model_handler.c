@@ -5,6 +5,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/mesh.h>
@@ -12,17 +13,21 @@
 #include <dk_buttons_and_leds.h>
 #include <zephyr/drivers/uart.h>
 #include "light_monitor_srv.h"
+#include "light_monitor_workq.h"
 #include "model_handler.h"
+#include "test_schedule.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <zephyr/drivers/adc.h>
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/random/rand32.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
 
@@ -32,9 +37,46 @@
 
 #define DT_SPEC_AND_COMMA(node_id, prop, idx) ADC_DT_SPEC_GET_BY_IDX(node_id, idx),
 
+/* Position of each io-channel in the devicetree, and in the scan buffer, as
+ * the SAADC stores the samples in the order of the channel numbers.
+ */
+#define ADC_CH_LDR 0
+#define ADC_CH_VDD 1
+#define ADC_CH_BATT 2
+
+#define ADC_USER_NODE DT_PATH(zephyr_user)
+#define ADC_CH_NUM(_idx) DT_IO_CHANNELS_INPUT_BY_IDX(ADC_USER_NODE, _idx)
+
+BUILD_ASSERT(DT_PROP_LEN(ADC_USER_NODE, io_channels) == 3,
+	     "io-channels must list the LDR, the supply and the battery");
+BUILD_ASSERT(ADC_CH_NUM(ADC_CH_LDR) < ADC_CH_NUM(ADC_CH_VDD) &&
+		     ADC_CH_NUM(ADC_CH_VDD) < ADC_CH_NUM(ADC_CH_BATT),
+	     "io-channels must be listed by increasing channel number, as they are scanned");
+
+/* Typical curve of a GL55 series LDR: 10 kOhm at 10 lux, and the resistance
+ * falls with the illuminance to the power of the gamma. Estimates, for real
+ * applications the sensor must be characterised.
+ */
+#define LDR_R10_OHM 10000.0f
+#define LDR_GAMMA 0.7f
+/* Largest illuminance of the Present Ambient Light Level property */
+#define AMB_LIGHT_LUX_MAX 167772.0f
+
 #define STANDARD_THRESHOLD_VALUE 3500
 #define STANDARD_THRESHOLD_VARIANCE 50
 #define DIGITAL_PIN 29
+#define SAMPLE_PERIOD_S CONFIG_BT_MESH_LIGHT_MONITOR_SAMPLE_PERIOD
+#define PROGRESS_STEP_S CONFIG_BT_MESH_LIGHT_MONITOR_PROGRESS_STEP
+#define PROGRESS_MARGIN_DELTA CONFIG_BT_MESH_LIGHT_MONITOR_PROGRESS_MARGIN_DELTA
+#define PROGRESS_MIN_INTERVAL_MS (CONFIG_BT_MESH_LIGHT_MONITOR_PROGRESS_MIN_INTERVAL * MSEC_PER_SEC)
+#define SUPPLY_CURVE_LEN CONFIG_BT_MESH_LIGHT_MONITOR_SUPPLY_CURVE_LEN
+#define BURST_TIMEOUT_MS CONFIG_BT_MESH_LIGHT_MONITOR_BURST_TIMEOUT_MS
+#define CALIBRATION_SAMPLES CONFIG_BT_MESH_LIGHT_MONITOR_CALIBRATION_SAMPLES
+#define CALIBRATION_SAMPLE_INTERVAL_MS CONFIG_BT_MESH_LIGHT_MONITOR_CALIBRATION_SAMPLE_INTERVAL_MS
+/* Sensor reads run ahead of everything else, the LEDs after everything else */
+#define SAMPLE_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_SAMPLE)
+#define REPLY_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_REPLY)
+#define LOG_WQ light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG)
 
 /* Data of ADC io-channels specified in devicetree. */
 static const struct adc_dt_spec adc_channels[] = { DT_FOREACH_PROP_ELEM(
@@ -62,7 +104,7 @@ static void attention_blink(struct k_work *work)
 
 	if (attention) {
 		dk_set_leds(pattern[idx++ % ARRAY_SIZE(pattern)]);
-		k_work_reschedule(&attention_blink_work, K_MSEC(30));
+		k_work_reschedule_for_queue(LOG_WQ, &attention_blink_work, K_MSEC(30));
 	} else {
 		dk_set_leds(DK_NO_LEDS_MSK);
 	}
@@ -71,7 +113,7 @@ static void attention_blink(struct k_work *work)
 static void attention_on(struct bt_mesh_model *mod)
 {
 	attention = true;
-	k_work_reschedule(&attention_blink_work, K_NO_WAIT);
+	k_work_reschedule_for_queue(LOG_WQ, &attention_blink_work, K_NO_WAIT);
 }
 
 static void attention_off(struct bt_mesh_model *mod)
@@ -90,53 +132,219 @@ static struct bt_mesh_health_srv health_srv = {
 };
 
 BT_MESH_HEALTH_PUB_DEFINE(health_pub, 0);
+
+/******************************************************************************/
+/**************************** Time server setup *******************************/
+/******************************************************************************/
+/* The node follows the TAI time published by the gateway, so results of tests
+ * it runs on its own are stamped correctly. A Time Server only takes the time
+ * from the status messages it receives in the Time Client or Time Relay role,
+ * the node is a Time Client until the gateway configures another role.
+ */
+static struct bt_mesh_time_srv time_srv = BT_MESH_TIME_SRV_INIT(NULL);
 /******************************************************************************/
 /**************************** peripheral setup ********************************/
 /******************************************************************************/
 /*The ADC, gpio out, timers, and uart are configured and logic for the test is handled here*/
 
-uint16_t adc_buf;
+/* All channels are sampled in a single scan, one sample per channel */
+static int16_t scan_buf[ARRAY_SIZE(adc_channels)];
 uint16_t test_duration;
+int64_t test_end;
 uint16_t ldr_value;
 uint32_t time_stamp_res;
 static struct bt_mesh_light_monitor monitor;
 static const struct device *gpio_dev;
 struct k_timer adc_timer;
 struct k_work adc_work;
-struct k_timer log_timer;
-struct k_work log_work;
+static struct k_work_delayable sensor_sample_work;
 struct adc_sequence sequence = {
-	.buffer = &adc_buf,
+	.buffer = scan_buf,
 	/* buffer size in bytes, not number of samples */
-	.buffer_size = sizeof(adc_buf),
+	.buffer_size = sizeof(scan_buf),
 };
+
+/* One scan of the light sensor and the supply */
+struct adc_scan {
+	uint16_t ldr;
+	uint16_t vdd_mv;
+	int16_t batt_mv;
+};
+
+/* Supply curves of the running test, recorded as a struct of arrays with the
+ * points spread evenly over the test duration.
+ */
+static struct supply_curve {
+	uint16_t ldr[SUPPLY_CURVE_LEN];
+	uint16_t vdd_mv[SUPPLY_CURVE_LEN];
+	int16_t batt_mv[SUPPLY_CURVE_LEN];
+	uint8_t len;
+	uint16_t vdd_min_mv;
+	int16_t batt_min_mv;
+} curve;
+
+/* The curves of the last test, printed from the log work queue a series per
+ * line, so the next test can't overwrite them while they're printed.
+ */
+static struct supply_curve curve_log;
+/* Error of the last result, printed with the curves */
+static int result_err;
+
+/* Switchover capture: the light sensor alone, sampled at a high rate from the
+ * relay switching until the light comes on. Every sample overwrites the last.
+ */
+static int16_t burst_buf;
+static enum adc_action burst_sampled(const struct device *dev,
+				     const struct adc_sequence *sequence, uint16_t sampling_index);
+static const struct adc_sequence_options burst_options = {
+	.interval_us = CONFIG_BT_MESH_LIGHT_MONITOR_BURST_INTERVAL_US,
+	.callback = burst_sampled,
+};
+static struct adc_sequence burst_sequence = {
+	.options = &burst_options,
+	.buffer = &burst_buf,
+	.buffer_size = sizeof(burst_buf),
+};
+
+static struct {
+	/* Cycle count when the relay switched, and when the light came on */
+	uint32_t start;
+	uint32_t lit;
+	/* Raw reading at the failure threshold, anything below it is lit */
+	int16_t lit_raw;
+	bool lit_seen;
+	/* Time the light took to come on, reported with the result */
+	uint16_t light_delay;
+} burst;
+
 static void adc_sampler_helper(struct k_work *adc_work);
-static void logger_helper(struct k_work *log_work);
-static uint16_t adc_read_with_return(void);
+static void burst_capture(struct k_work *work);
+static struct adc_scan adc_scan_read(void);
+static K_WORK_DEFINE(burst_work, burst_capture);
 K_WORK_DEFINE(adc_work, adc_sampler_helper);
-K_WORK_DEFINE(log_work, logger_helper);
 uint16_t test_failure_threshold = STANDARD_THRESHOLD_VALUE;
 
 bool final_result = true;
+bool scheduled_test;
+
+/* Progress of the running test, as last reported to the gateway */
+static struct {
+	int64_t last_sent;
+	uint16_t last_step;
+	int16_t last_margin;
+	uint16_t darkest;
+} progress;
+
+/* Unix time, or 0 if no time was received from the gateway yet */
+static uint32_t current_time_stamp(void)
+{
+	struct bt_mesh_time_status status;
+
+	if (bt_mesh_time_srv_status(&time_srv, k_uptime_get(), &status)) {
+		return 0;
+	}
+
+	return status.tai_sec + MESH_TAI_EPOCH_UNIX - status.tai_utc_delta;
+}
+
+/* Log entries are sent with their age in minutes instead of a timestamp. The
+ * age of a test run without the network time, or read back before the node
+ * got the time again after a reboot, is unknown.
+ */
+static uint32_t result_age(const struct test_result *entry)
+{
+	uint32_t now = current_time_stamp();
+
+	if (!entry->synced || now == 0) {
+		return RESULT_LOG_AGE_UNKNOWN;
+	}
+
+	if (entry->time_stamp > now) {
+		return 0;
+	}
+
+	return (now - entry->time_stamp) / 60;
+}
+
+/* Printed after every test, as the test is the load the queues are sized for */
+static void workq_stats_print(void)
+{
+	struct light_monitor_workq_stats stats;
+
+	for (int i = 0; i < LIGHT_MONITOR_WORKQ_COUNT; i++) {
+		if (light_monitor_workq_stats_get(i, &stats)) {
+			return;
+		}
+
+		printk("Workq %s: latency %u us, max %u us, stack %zu/%zu bytes unused\n", stats.name,
+		       stats.latency_us, stats.latency_max_us, stats.stack_unused,
+		       stats.stack_size);
+	}
+}
+
+/* The printing of a finished test is left to the log work queue, so the
+ * sample work queue is free for the next test.
+ */
+static void result_print(struct k_work *work)
+{
+	printk("Curve ldr:");
+	for (int i = 0; i < curve_log.len; i++) {
+		printk(" %u", curve_log.ldr[i]);
+	}
+
+	printk("\nCurve vdd mV:");
+	for (int i = 0; i < curve_log.len; i++) {
+		printk(" %u", curve_log.vdd_mv[i]);
+	}
+
+	printk("\nCurve battery mV:");
+	for (int i = 0; i < curve_log.len; i++) {
+		printk(" %d", curve_log.batt_mv[i]);
+	}
+
+	printk("\n");
+
+	workq_stats_print();
+
+	if (result_err < 0) {
+		printk("err is %d", result_err);
+	}
+}
+
+static K_WORK_DEFINE(result_print_work, result_print);
 
 /*Finished the test run, resets the status of the monitor to allow for another test to be started*/
 static void finalize_result(struct k_timer *adc_timer)
 {
 	int err;
 
-	struct test_result this_result = { .result = final_result, .time_stamp = time_stamp_res };
+	/* Stored results with a zero timestamp are considered empty */
+	struct test_result this_result = {
+		.result = final_result,
+		.synced = time_stamp_res != 0,
+		.time_stamp = time_stamp_res ? time_stamp_res : 1 + k_uptime_get() / MSEC_PER_SEC,
+	};
 	monitor.res_sto.last_result_idx = (monitor.res_sto.last_result_idx + 1) % 8;
 	monitor.res_sto.results[monitor.res_sto.last_result_idx] = this_result;
 
-	err = send_test_result(&monitor, final_result);
+	if (scheduled_test) {
+		/* Results of scheduled tests are only journaled, the gateway harvests them */
+		err = store_test_results(&monitor);
+	} else {
+		err = send_test_result(&monitor, final_result, curve.vdd_min_mv, curve.batt_min_mv,
+				       burst.light_delay);
+	}
+	scheduled_test = false;
 	time_stamp_res = 0;
 	final_result = true;
 	test_running = false;
 	test_duration = 0;
 	gpio_pin_set(gpio_dev, DIGITAL_PIN, 0);
 
-	if (err < 0) {
-		printk("err is %d", err);
+	if (!k_work_busy_get(&result_print_work)) {
+		curve_log = curve;
+		result_err = err;
+		k_work_submit_to_queue(LOG_WQ, &result_print_work);
 	}
 }
 
@@ -151,46 +359,235 @@ static uint16_t resistance_calculation(uint16_t adc_value)
 	return ldrResistance;
 }
 
+/* Illuminance estimated from the LDR resistance, for the Sensor Server, which
+ * reports the standard Present Ambient Light Level in lux.
+ */
+static void lux_estimate(uint16_t resistance, struct sensor_value *lux)
+{
+	float value = AMB_LIGHT_LUX_MAX;
+
+	if (resistance) {
+		value = MIN(10.0f * powf(LDR_R10_OHM / resistance, 1.0f / LDR_GAMMA),
+			    AMB_LIGHT_LUX_MAX);
+	}
+
+	lux->val1 = value;
+	lux->val2 = (value - lux->val1) * 1000000;
+}
+
+/* Progress is only published when the test crosses a step boundary or the
+ * margin to the threshold moves noticeably, and never more often than the
+ * minimum interval, so a steady test costs a handful of messages per node.
+ */
+static void progress_update(void)
+{
+	int64_t now = k_uptime_get();
+	struct light_monitor_test_progress msg = {
+		.elapsed = MAX(now - (test_end - (int64_t)test_duration * MSEC_PER_SEC), 0) /
+			   MSEC_PER_SEC,
+		.current = ldr_value,
+		.margin = CLAMP((int32_t)test_failure_threshold - ldr_value, INT16_MIN, INT16_MAX),
+	};
+	uint16_t step = msg.elapsed / PROGRESS_STEP_S;
+
+	progress.darkest = MAX(progress.darkest, ldr_value);
+	msg.darkest = progress.darkest;
+
+	if (step == progress.last_step &&
+	    abs(msg.margin - progress.last_margin) < PROGRESS_MARGIN_DELTA) {
+		return;
+	}
+
+	if (progress.last_step != UINT16_MAX &&
+	    now - progress.last_sent < PROGRESS_MIN_INTERVAL_MS) {
+		return;
+	}
+
+	if (send_test_progress(&monitor, &msg)) {
+		return;
+	}
+
+	progress.last_sent = now;
+	progress.last_step = step;
+	progress.last_margin = msg.margin;
+}
+
+static void curve_record(const struct adc_scan *scan)
+{
+	int64_t elapsed = k_uptime_get() - (test_end - (int64_t)test_duration * MSEC_PER_SEC);
+	int point = elapsed * SUPPLY_CURVE_LEN / MAX((int64_t)test_duration * MSEC_PER_SEC, 1);
+
+	curve.vdd_min_mv = MIN(curve.vdd_min_mv, scan->vdd_mv);
+	curve.batt_min_mv = MIN(curve.batt_min_mv, scan->batt_mv);
+
+	if (point < curve.len || curve.len >= SUPPLY_CURVE_LEN) {
+		return;
+	}
+
+	curve.ldr[curve.len] = ldr_value;
+	curve.vdd_mv[curve.len] = scan->vdd_mv;
+	curve.batt_mv[curve.len] = scan->batt_mv;
+	curve.len++;
+}
+
 static void adc_sampler_helper(struct k_work *adc_work)
 {
+	struct adc_scan scan = adc_scan_read();
 
-	ldr_value = resistance_calculation(adc_read_with_return());
+	ldr_value = resistance_calculation(scan.ldr);
 	printk("Value is %d\n", ldr_value);
+	curve_record(&scan);
+	(void)bt_mesh_sensor_srv_sample(&monitor.sensor_srv, &monitor.light_sensor);
+	if (!scheduled_test) {
+		progress_update();
+	}
 	if (ldr_value > test_failure_threshold) {
 		final_result = false;
 		k_timer_stop(&adc_timer);
 	}
-	if (test_duration-- < 1) {
+	if (k_uptime_get() >= test_end) {
 		k_timer_stop(&adc_timer);
 	}
 
 }
 
-static uint16_t adc_read_with_return(void)
+static int32_t scan_mv(int ch)
+{
+	int32_t val = scan_buf[ch];
+
+	if (ch >= ARRAY_SIZE(adc_channels) || adc_raw_to_millivolts_dt(&adc_channels[ch], &val)) {
+		return 0;
+	}
+
+	return val;
+}
+
+/* The LDR, the supply and the battery are read in a single scan, so the
+ * supply curves cost no extra wakeup.
+ */
+static struct adc_scan adc_scan_read(void)
 {
 	int err;
 
-	(void)adc_sequence_init_dt(&adc_channels[0], &sequence);
-	err = adc_read(adc_channels[0].dev, &sequence);
+	err = adc_read(adc_channels[ADC_CH_LDR].dev, &sequence);
 	if (err < 0) {
 		printk("Could not read (%d)\n", err);
 	}
-	return (uint16_t)adc_buf;
+
+	return (struct adc_scan){
+		.ldr = MAX(scan_buf[ADC_CH_LDR], 0),
+		.vdd_mv = CLAMP(scan_mv(ADC_CH_VDD), 0, UINT16_MAX),
+		.batt_mv = CLAMP(scan_mv(ADC_CH_BATT), INT16_MIN, INT16_MAX),
+	};
 }
 
 static void adc_work_handler(struct k_timer *timer)
 {
-	k_work_submit(&adc_work);
+	k_work_submit_to_queue(SAMPLE_WQ, &adc_work);
+}
+
+/* Inverse of resistance_calculation(), so the capture compares raw readings */
+static int16_t resistance_to_adc(uint16_t resistance)
+{
+	return (5000 * (uint32_t)resistance) / (10000 + resistance);
+}
+
+/* Called from the ADC interrupt after every sample of the capture */
+static enum adc_action burst_sampled(const struct device *dev,
+				     const struct adc_sequence *sequence, uint16_t sampling_index)
+{
+	uint32_t now = k_cycle_get_32();
+
+	if (burst_buf <= burst.lit_raw) {
+		burst.lit = now;
+		burst.lit_seen = true;
+		return ADC_ACTION_FINISH;
+	}
+
+	if (k_cyc_to_ms_floor32(now - burst.start) >= BURST_TIMEOUT_MS) {
+		return ADC_ACTION_FINISH;
+	}
+
+	return ADC_ACTION_REPEAT;
+}
+
+/* Runs from the moment the relay switches, then hands over to the test
+ * sampling period.
+ */
+static void burst_capture(struct k_work *work)
+{
+	int err;
+
+	burst.lit_seen = false;
+	burst.lit_raw = resistance_to_adc(test_failure_threshold);
+
+	err = adc_read(adc_channels[ADC_CH_LDR].dev, &burst_sequence);
+	if (err < 0) {
+		printk("Switchover capture failed (%d)\n", err);
+	}
+
+	if (burst.lit_seen) {
+		uint32_t delay_us = k_cyc_to_us_floor32(burst.lit - burst.start);
+
+		burst.light_delay = MIN(delay_us / LIGHT_DELAY_UNIT_US, LIGHT_DELAY_NONE - 1);
+		printk("Light on %u us after the switchover\n", delay_us);
+	} else {
+		printk("Light not on %d ms after the switchover\n", BURST_TIMEOUT_MS);
+	}
+
+	k_work_submit_to_queue(SAMPLE_WQ, &adc_work);
+	k_timer_start(&adc_timer, K_SECONDS(SAMPLE_PERIOD_S), K_SECONDS(SAMPLE_PERIOD_S));
 }
 
 static void test_start(const uint16_t duration)
 {
 	test_duration = duration;
-	gpio_pin_set(gpio_dev, DIGITAL_PIN, 1);
+	test_end = k_uptime_get() + (int64_t)duration * MSEC_PER_SEC;
+	progress.last_step = UINT16_MAX;
+	progress.darkest = 0;
+	curve.len = 0;
+	curve.vdd_min_mv = UINT16_MAX;
+	curve.batt_min_mv = INT16_MAX;
+	burst.light_delay = LIGHT_DELAY_NONE;
 	k_timer_init(&adc_timer, adc_work_handler, finalize_result);
-	k_timer_start(&adc_timer, K_SECONDS(1), K_SECONDS(1));
+	gpio_pin_set(gpio_dev, DIGITAL_PIN, 1);
+	burst.start = k_cycle_get_32();
+	k_work_submit_to_queue(SAMPLE_WQ, &burst_work);
 }
 
+#ifdef CONFIG_BT_MESH_LOW_POWER
+/* A Low Power Node reads the sensor on every friend poll, and restarts the
+ * sampling period from there, so the ADC and the radio share their wakeups.
+ */
+static void lpn_polled(uint16_t net_idx, uint16_t friend_addr, bool retry)
+{
+	/* The switchover capture starts the sampling period when it's done */
+	if (test_running && !k_work_busy_get(&burst_work)) {
+		k_work_submit_to_queue(SAMPLE_WQ, &adc_work);
+		k_timer_start(&adc_timer, K_SECONDS(SAMPLE_PERIOD_S), K_SECONDS(SAMPLE_PERIOD_S));
+	}
+
+	result_retx_on_poll(&monitor);
+}
+
+static void lpn_established(uint16_t net_idx, uint16_t friend_addr, uint8_t queue_size,
+			    uint8_t recv_win)
+{
+	printk("Friendship established with 0x%04x\n", friend_addr);
+}
+
+static void lpn_terminated(uint16_t net_idx, uint16_t friend_addr)
+{
+	printk("Friendship with 0x%04x terminated\n", friend_addr);
+}
+
+BT_MESH_LPN_CB_DEFINE(lpn_cb) = {
+	.established = lpn_established,
+	.terminated = lpn_terminated,
+	.polled = lpn_polled,
+};
+#endif
+
 static void adc_init(void)
 {
 	int err;
@@ -207,7 +604,20 @@ static void adc_init(void)
 			printk("Could not setup channel #%d (%d)\n", i, err);
 			return;
 		}
+
+		/* A scan shares one resolution and can't be oversampled */
+		if (adc_channels[i].resolution != adc_channels[ADC_CH_LDR].resolution ||
+		    adc_channels[i].oversampling) {
+			printk("Channel #%d can't be scanned with the others\n", i);
+			return;
+		}
+
+		sequence.channels |= BIT(adc_channels[i].channel_id);
 	}
+
+	sequence.resolution = adc_channels[ADC_CH_LDR].resolution;
+	burst_sequence.channels = BIT(adc_channels[ADC_CH_LDR].channel_id);
+	burst_sequence.resolution = adc_channels[ADC_CH_LDR].resolution;
 }
 
 static void button_handler_cb(uint32_t pressed, uint32_t changed)
@@ -233,13 +643,105 @@ static void button_handler_cb(uint32_t pressed, uint32_t changed)
 
 }
 
-static void calibrate_sensor(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
-{	
-	uint16_t calibration_value;
-	calibration_value = resistance_calculation(adc_read_with_return());
-	test_failure_threshold = calibration_value + STANDARD_THRESHOLD_VARIANCE;
-	printk("New calibrated value is %d", calibration_value);
-	send_calibrated_ok(monitor);
+/* A node calibrates once per calibration round. The gateway asks the nodes
+ * that didn't answer again with the same round, and they only repeat their
+ * answer, so a lost answer doesn't move the threshold again.
+ */
+static struct {
+	struct light_monitor_calibrate_status status;
+	/* Window to spread the answer over, in units of CALIBRATE_WINDOW_UNIT_MS */
+	uint16_t window;
+	/* Samples taken so far in the running calibration */
+	uint16_t samples;
+	uint16_t lowest;
+	uint16_t highest;
+	uint32_t sum;
+	enum {
+		CALIB_NONE,
+		CALIB_RUNNING,
+		CALIB_DONE,
+	} state;
+} calib;
+
+static void calibrate_run(struct k_work *work);
+static void calibrate_reply(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(calib_work, calibrate_run);
+static K_WORK_DELAYABLE_DEFINE(calib_reply_work, calibrate_reply);
+
+/* Answers to a group calibration are spread over the window, so a whole site
+ * doesn't answer at once.
+ */
+static void calibrate_reply_schedule(void)
+{
+	uint32_t delay_ms = 0;
+
+	if (calib.window) {
+		delay_ms = sys_rand32_get() % ((uint32_t)calib.window * CALIBRATE_WINDOW_UNIT_MS);
+	}
+
+	k_work_reschedule_for_queue(REPLY_WQ, &calib_reply_work, K_MSEC(delay_ms));
+}
+
+static void calibrate_reply(struct k_work *work)
+{
+	send_calibrated_ok(&monitor, &calib.status);
+}
+
+/* One sample is taken per run, so the sample work queue isn't held between
+ * the samples.
+ */
+static void calibrate_run(struct k_work *work)
+{
+	uint16_t value = resistance_calculation(adc_scan_read().ldr);
+	uint16_t mean;
+
+	calib.sum += value;
+	calib.lowest = MIN(calib.lowest, value);
+	calib.highest = MAX(calib.highest, value);
+
+	if (++calib.samples < CALIBRATION_SAMPLES) {
+		k_work_reschedule_for_queue(SAMPLE_WQ, &calib_work,
+					    K_MSEC(CALIBRATION_SAMPLE_INTERVAL_MS));
+		return;
+	}
+
+	mean = calib.sum / CALIBRATION_SAMPLES;
+	calib.status.noise = calib.highest - calib.lowest;
+	/* A noisy sensor gets a wider margin, so the noise alone can't fail a test */
+	test_failure_threshold =
+		MIN(mean + MAX(STANDARD_THRESHOLD_VARIANCE, calib.status.noise), UINT16_MAX);
+	calib.status.threshold = test_failure_threshold;
+	calib.state = CALIB_DONE;
+	printk("New calibrated value is %d, noise %d\n", mean, calib.status.noise);
+
+	calibrate_reply_schedule();
+}
+
+static void calibrate_sensor(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+			     const struct light_monitor_calibrate *msg)
+{
+	if (test_running) {
+		printk("Calibration skipped, a test is running\n");
+		return;
+	}
+
+	calib.window = msg->window;
+
+	if (calib.state != CALIB_NONE && msg->seq == calib.status.seq) {
+		/* The answer is sent when the running calibration is done */
+		if (calib.state == CALIB_DONE) {
+			calibrate_reply_schedule();
+		}
+		return;
+	}
+
+	calib.status.seq = msg->seq;
+	calib.state = CALIB_RUNNING;
+	calib.samples = 0;
+	calib.lowest = UINT16_MAX;
+	calib.highest = 0;
+	calib.sum = 0;
+	k_work_reschedule_for_queue(SAMPLE_WQ, &calib_work, K_NO_WAIT);
 }
 
 /******************************************************************************/
@@ -250,62 +752,72 @@ static void calibrate_sensor(struct bt_mesh_light_monitor *monitor, struct bt_me
 static void handle_start(struct bt_mesh_light_monitor *monitor)
 {
 	printk("Started \n");
+	k_work_reschedule_for_queue(SAMPLE_WQ, &sensor_sample_work, K_NO_WAIT);
 }
 
 static void handle_test_start(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
-			      uint16_t duration, uint32_t time_stamp)
+			      uint16_t duration)
 {
 	if (test_running) {
 		printk("Wait for existing test to finish before starting a new test \n");
 	} else {
 		test_running = true;
-		time_stamp_res = time_stamp;
+		time_stamp_res = current_time_stamp();
 
 		test_start(duration);
 		send_test_ack(monitor);
 	}
 }
-int logger_index;
-struct bt_mesh_light_monitor *logging_monitor;
-static void logger_helper(struct k_work *log_work)
+static bool scheduled_test_start(uint16_t duration)
 {
-	if (logger_index == logging_monitor->res_sto.last_result_idx) {
-		k_timer_stop(&log_timer);
-	} else if (logging_monitor->res_sto.results[logger_index].time_stamp == 0) {
-		printk("Empty log entry \n");
-		logger_index--;
-		if (logger_index < 0) {
-			logger_index = 7;
-		}
+	if (test_running) {
+		return false;
 	}
 
-	else {
-		send_logged_result(logging_monitor,
-				   logging_monitor->res_sto.results[logger_index].time_stamp,
-				   logging_monitor->res_sto.results[logger_index].result);
-		logger_index--;
-		if (logger_index < 0) {
-			logger_index = 7;
-		}
-	}
+	test_running = true;
+	scheduled_test = true;
+	time_stamp_res = current_time_stamp();
+	test_start(duration);
+
+	return true;
 }
 
-static void log_work_handler(struct k_timer *timer)
+static void handle_schedule(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx,
+			    const struct test_schedule *schedule)
 {
-	k_work_submit(&log_work);
+	printk("Test schedule set, functional every %d days, duration every %d days\n",
+	       schedule->fn_period, schedule->full_period);
+
+	/* A stored schedule is passed without a context after a reboot */
+	if (ctx) {
+		test_schedule_set(schedule);
+	} else {
+		test_schedule_resume(schedule);
+	}
 }
 
 static int handle_get_log(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
 {
-	printk("Time stamp in handler is %d \n",
-	       monitor->res_sto.results[monitor->res_sto.last_result_idx].time_stamp);
-	send_logged_result(monitor,
-			   monitor->res_sto.results[monitor->res_sto.last_result_idx].time_stamp,
-			   monitor->res_sto.results[monitor->res_sto.last_result_idx].result);
-	logger_index = monitor->res_sto.last_result_idx - 1;
-	k_timer_init(&log_timer, log_work_handler, NULL);
-	k_timer_start(&log_timer, K_SECONDS(0.05), K_SECONDS(0.05));
-	logging_monitor = monitor;
+	size_t count = ARRAY_SIZE(monitor->res_sto.results);
+
+	/* The whole log is queued at once, newest entry first, and the send
+	 * queue paces it out behind any result or ack.
+	 */
+	for (size_t i = 0; i < count; i++) {
+		size_t idx = (monitor->res_sto.last_result_idx + count - i) % count;
+		struct test_result *entry = &monitor->res_sto.results[idx];
+
+		if (entry->time_stamp == 0) {
+			continue;
+		}
+
+		if (send_logged_result(monitor, result_age(entry), entry->result,
+				       entry->reported)) {
+			printk("Log dump cut short, send queue is full\n");
+			break;
+		}
+	}
+
 	return 0;
 }
 
@@ -329,8 +841,11 @@ static int handle_get_sensor(struct bt_mesh_light_monitor *monitor, struct bt_me
 
 static int handle_get_result(struct bt_mesh_light_monitor *monitor, struct bt_mesh_msg_ctx *ctx)
 {
-	send_test_result(monitor,
-			 monitor->res_sto.results[monitor->res_sto.last_result_idx].result);
+	/* Answer with the sequence number of the pending result, so the ack
+	 * also stops its retransmission.
+	 */
+	monitor->result_value = monitor->res_sto.results[monitor->res_sto.last_result_idx].result;
+	resend_test_result(monitor);
 	return 0;
 }
 
@@ -345,18 +860,62 @@ static const struct bt_light_monitor_handlers monitor_handlers = {
 
 static const struct bt_light_monitor_setup_handlers setup_handlers = {
 	.calibrate = calibrate_sensor,
+	.schedule = handle_schedule,
+};
+
+/******************************************************************************/
+/**************************** Sensor server setup *****************************/
+/******************************************************************************/
+/* The LDR reading is also exposed through a standard Sensor Server. The
+ * gateway sets its cadence, so a reading that moves by more than the delta is
+ * published right away, and at the configured publish period otherwise. The
+ * vendor status message carries the LDR resistance, the Sensor Server the
+ * illuminance estimated from it.
+ */
+static int light_sensor_get(struct bt_mesh_sensor_srv *srv, struct bt_mesh_sensor *sensor,
+			    struct bt_mesh_msg_ctx *ctx, struct sensor_value *rsp)
+{
+	lux_estimate(ldr_value, rsp);
+
+	return 0;
+}
+
+/* Tests sample the sensor on their own, in between the reading is refreshed
+ * here so the Sensor Server can check it against the cadence delta.
+ */
+static void sensor_sample(struct k_work *work)
+{
+	if (!test_running) {
+		ldr_value = resistance_calculation(adc_scan_read().ldr);
+		(void)bt_mesh_sensor_srv_sample(&monitor.sensor_srv, &monitor.light_sensor);
+	}
+
+	k_work_reschedule_for_queue(SAMPLE_WQ, &sensor_sample_work,
+				    K_SECONDS(CONFIG_BT_MESH_LIGHT_MONITOR_SENSOR_SAMPLE_PERIOD));
+}
+
+static struct bt_mesh_sensor *const monitor_sensors[] = {
+	&monitor.light_sensor,
 };
 
 static struct bt_mesh_light_monitor monitor = {
 	.handlers = &monitor_handlers,
 	.setup_handlers = &setup_handlers,
+	.result_light_delay = LIGHT_DELAY_NONE,
+	.sensor_srv = BT_MESH_SENSOR_SRV_INIT(monitor_sensors, ARRAY_SIZE(monitor_sensors)),
+	.light_sensor = {
+		.type = &bt_mesh_sensor_present_amb_light_level,
+		.get = light_sensor_get,
+	},
 };
 
 
 static struct bt_mesh_elem elements[] = {
 	BT_MESH_ELEM(1,
 		     BT_MESH_MODEL_LIST(BT_MESH_MODEL_CFG_SRV,
-					BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub)),
+					BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub),
+					BT_MESH_MODEL_TIME_SRV(&time_srv),
+					BT_MESH_MODEL_SENSOR_SRV(&monitor.sensor_srv)),
 		     BT_MESH_MODEL_LIST(BT_MESH_MODEL_LIGHT_MONITOR(&monitor))),
 };
 
@@ -369,7 +928,11 @@ static const struct bt_mesh_comp comp = {
 const struct bt_mesh_comp *model_handler_init(void)
 {
 	k_work_init_delayable(&attention_blink_work, attention_blink);
+	k_work_init_delayable(&sensor_sample_work, sensor_sample);
+	/* A role configured by the gateway is restored with the settings */
+	time_srv.data.role = BT_MESH_TIME_CLIENT;
 	adc_init();
+	test_schedule_init(scheduled_test_start, current_time_stamp);
 	static struct button_handler button_handler = {
 		.cb = button_handler_cb,
 	};
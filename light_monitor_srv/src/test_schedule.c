@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include "light_monitor_workq.h"
+#include "test_schedule.h"
+
+#define MINUTES_PER_DAY (24 * 60)
+#define SEC_PER_MIN 60
+#define SEC_PER_DAY (MINUTES_PER_DAY * SEC_PER_MIN)
+/* A due test that finds the node busy is retried after this many minutes */
+#define TEST_SCHEDULE_RETRY_MIN 1
+/* Without the network time, the node checks for it this often */
+#define TEST_SCHEDULE_SYNC_WAIT_MIN 10
+/* Longest wait before the due time is checked again against the network
+ * time, so a correction of the time by the gateway is taken into account.
+ */
+#define TEST_SCHEDULE_RECHECK_MIN MINUTES_PER_DAY
+
+/* Unix times of the schedule start and of the last test of each kind, kept
+ * across reboots so a reboot doesn't restart the schedule. 0 if unknown.
+ */
+static struct {
+	uint32_t start;
+	uint32_t fn_last;
+	uint32_t full_last;
+} runs;
+
+static struct test_schedule schedule;
+static test_schedule_run_t run_cb;
+static test_schedule_time_t time_cb;
+static struct k_work_delayable fn_work;
+static struct k_work_delayable full_work;
+
+static void runs_save(struct k_work *work)
+{
+	int err = settings_save_one("lm_sched/runs", &runs, sizeof(runs));
+
+	if (err) {
+		printk("Storing the test runs failed (err %d)\n", err);
+	}
+}
+
+/* Flash writes are kept off the sample work queue */
+static K_WORK_DEFINE(runs_save_work, runs_save);
+
+static void runs_store(void)
+{
+	k_work_submit_to_queue(light_monitor_workq(LIGHT_MONITOR_WORKQ_LOG), &runs_save_work);
+}
+
+/* Schedule periods are up to a year, which overflows K_MINUTES(). Tests are
+ * started from the sample work queue, so they start on time.
+ */
+static void schedule_in(struct k_work_delayable *work, uint32_t minutes)
+{
+	(void)k_work_reschedule_for_queue(light_monitor_workq(LIGHT_MONITOR_WORKQ_SAMPLE), work,
+					  K_MSEC((int64_t)minutes * 60 * MSEC_PER_SEC));
+}
+
+/* Unix time the next test of a kind is due. The first test is due when the
+ * offset of the schedule has elapsed, plus the given delay.
+ */
+static uint64_t due_time(uint32_t last, uint32_t period_days, uint32_t first_delay_min)
+{
+	if (last) {
+		return last + (uint64_t)period_days * SEC_PER_DAY;
+	}
+
+	return runs.start + ((uint64_t)schedule.offset + first_delay_min) * SEC_PER_MIN;
+}
+
+/* Starts the test if it is due, and returns the minutes until the work should
+ * run again.
+ */
+static uint32_t test_check(uint32_t *last, uint32_t period_days, uint32_t first_delay_min,
+			   uint16_t duration, const char *name)
+{
+	uint32_t now = time_cb();
+	uint64_t due;
+
+	if (now == 0) {
+		return TEST_SCHEDULE_SYNC_WAIT_MIN;
+	}
+
+	/* The offset of a schedule set before the node had the time counts
+	 * from the moment it got it.
+	 */
+	if (runs.start == 0) {
+		runs.start = now;
+		runs_store();
+	}
+
+	due = due_time(*last, period_days, first_delay_min);
+	if (now < due) {
+		return MIN(DIV_ROUND_UP(due - now, SEC_PER_MIN), TEST_SCHEDULE_RECHECK_MIN);
+	}
+
+	if (!run_cb(duration)) {
+		return TEST_SCHEDULE_RETRY_MIN;
+	}
+
+	printk("Started scheduled %s test\n", name);
+	*last = now;
+	runs_store();
+
+	return MIN(period_days * MINUTES_PER_DAY, TEST_SCHEDULE_RECHECK_MIN);
+}
+
+static void fn_test_run(struct k_work *work)
+{
+	schedule_in(&fn_work, test_check(&runs.fn_last, schedule.fn_period, 0,
+					 schedule.fn_duration, "functional"));
+}
+
+/* The first duration test is due one full period after the offset */
+static void full_test_run(struct k_work *work)
+{
+	schedule_in(&full_work,
+		    test_check(&runs.full_last, schedule.full_period,
+			       schedule.full_period * MINUTES_PER_DAY, schedule.full_duration * 60,
+			       "duration"));
+}
+
+/* The due times are checked against the network time after the given delay */
+static void schedule_start(const struct test_schedule *new_schedule, uint32_t delay_min)
+{
+	schedule = *new_schedule;
+
+	k_work_cancel_delayable(&fn_work);
+	k_work_cancel_delayable(&full_work);
+
+	if (schedule.fn_period && schedule.fn_duration) {
+		schedule_in(&fn_work, delay_min);
+	}
+
+	if (schedule.full_period && schedule.full_duration) {
+		schedule_in(&full_work, delay_min);
+	}
+}
+
+static bool schedule_equal(const struct test_schedule *a, const struct test_schedule *b)
+{
+	return a->fn_period == b->fn_period && a->fn_duration == b->fn_duration &&
+	       a->full_period == b->full_period && a->full_duration == b->full_duration &&
+	       a->offset == b->offset;
+}
+
+void test_schedule_set(const struct test_schedule *new_schedule)
+{
+	/* The gateway sending the same schedule again doesn't restart it */
+	if (!schedule_equal(&schedule, new_schedule)) {
+		runs.start = time_cb();
+		runs.fn_last = 0;
+		runs.full_last = 0;
+		runs_store();
+	}
+
+	schedule_start(new_schedule, 0);
+}
+
+void test_schedule_resume(const struct test_schedule *stored)
+{
+	/* A test missed while the node was off waits for the offset of the
+	 * node, so the nodes don't all start their tests together when the
+	 * power comes back.
+	 */
+	schedule_start(stored, stored->offset);
+}
+
+static int runs_set(const char *name, size_t len_rd, settings_read_cb read_cb, void *cb_arg)
+{
+	ssize_t bytes;
+
+	if (!settings_name_steq(name, "runs", NULL)) {
+		return -ENOENT;
+	}
+
+	bytes = read_cb(cb_arg, &runs, sizeof(runs));
+	if (bytes < 0) {
+		return bytes;
+	}
+
+	if (bytes != 0 && bytes != sizeof(runs)) {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(test_schedule, "lm_sched", NULL, runs_set, NULL, NULL);
+
+void test_schedule_init(test_schedule_run_t run, test_schedule_time_t time)
+{
+	run_cb = run;
+	time_cb = time;
+	k_work_init_delayable(&fn_work, fn_test_run);
+	k_work_init_delayable(&full_work, full_test_run);
+}
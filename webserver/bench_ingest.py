@@ -0,0 +1,90 @@
+"""Replays gateway output through the ingest pipeline as fast as it goes.
+
+Reads a capture recorded with fake_gateway.py --record, or generates one for a
+site of N nodes, and feeds it from memory through ingest.Pipeline:
+
+    python3 bench_ingest.py --capture site.txt --repeat 10
+    python3 bench_ingest.py --nodes 2000 --lines 100000
+
+Prints the throughput next to the line rate of the gateway's serial port, and
+the statistics of every stage.
+"""
+import argparse
+import asyncio
+import io
+import json
+import queue
+import random
+import time
+
+import ingest
+
+BAUD_RATE = 115200
+# Start and stop bits of every byte on the serial port
+BITS_PER_BYTE = 10
+
+
+def synthetic_lines(nodes, count, seed):
+    """Lines in the proportions of a site running a campaign."""
+    rng = random.Random(seed)
+    addrs = range(2, 2 + nodes)
+    lines = []
+    for _ in range(count):
+        addr = rng.choice(addrs)
+        kind = rng.random()
+        if kind < 0.5:
+            lines.append("progress {} {} {} {} {}".format(
+                addr, rng.randint(0, 10800), rng.randint(500, 3500),
+                rng.randint(500, 3500), rng.randint(-1000, 3000)))
+        elif kind < 0.8:
+            lines.append("status {} {}".format(addr, rng.randint(500, 1500)))
+        elif kind < 0.95:
+            lines.append("result {} {} {}".format(
+                addr, rng.choice(("passed", "failed")), 1700000000))
+        else:
+            lines.append("logged {} {} {}".format(rng.randint(0, 1), 1700000000, addr))
+    return lines
+
+
+def capture_lines(path):
+    """Lines of a capture, without their time stamps."""
+    with open(path) as capture:
+        return [line.rstrip("\n").split(" ", 1)[1] for line in capture if " " in line]
+
+
+def handle(line):
+    # As cheap as a handler gets, so the pipeline itself is measured
+    return [("out", line.split(maxsplit=1)[-1])]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--capture", help="capture of fake_gateway.py --record to replay")
+    parser.add_argument("--repeat", type=int, default=1, help="times the capture is replayed")
+    parser.add_argument("--nodes", type=int, default=1000, help="nodes of the generated site")
+    parser.add_argument("--lines", type=int, default=100000, help="number of generated lines")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the generated lines")
+    args = parser.parse_args()
+
+    if args.capture:
+        lines = capture_lines(args.capture) * args.repeat
+    else:
+        lines = synthetic_lines(args.nodes, args.lines, args.seed)
+    data = "".join("uart:~$ {}\r\n".format(line) for line in lines).encode("utf-8")
+
+    pipeline = ingest.Pipeline(io.BytesIO(data), {"default": handle},
+                               {"out": queue.Queue(ingest.STAGE_QUEUE_SIZE)},
+                               stop_on_eof=True)
+    started = time.monotonic()
+    asyncio.run(pipeline.run())
+    elapsed = time.monotonic() - started
+
+    serial_rate = BAUD_RATE / BITS_PER_BYTE * len(lines) / len(data)
+    print("{} lines, {} bytes in {:.2f} s: {:.0f} lines/s, the serial port carries {:.0f} lines/s"
+          .format(len(lines), len(data), elapsed, len(lines) / elapsed, serial_rate))
+    print(json.dumps(pipeline.stats(), indent=2))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,21 +1,31 @@
+import asyncio
 import serial
 import time
 import random
 import queue
 import json
+import os
 import threading
 import struct
 import re
-from flask import Flask, jsonify, render_template, request
+import zlib
+from collections import deque
+from flask import Flask, Response, jsonify, render_template, request, stream_with_context
 from datetime import datetime
+import history
+import ingest
+import rollup
 
 
 
 app = Flask(__name__)
 clear = "\n"
-serial_buffer_status = queue.Queue(0)
-serial_buffer_result = queue.Queue(0)
-serial_buffer_log = queue.Queue(0)
+# Bounded, the ingestion pipeline drops the oldest entries if nobody polls
+SINK_SIZE = 4096
+serial_buffer_status = queue.Queue(SINK_SIZE)
+serial_buffer_result = queue.Queue(SINK_SIZE)
+serial_buffer_log = queue.Queue(SINK_SIZE)
+serial_buffer_sweep = queue.Queue(SINK_SIZE)
 Log_dict = {}
 port_test = 9
 buffer_temp = []
@@ -23,8 +33,10 @@ text = ''
 remaining_elements = []
 nodes_missing_list = []
 nameList = ['/dev/ttyACM0','/dev/ttyACM1','/dev/ttyACM2','/dev/ttyACM3','/dev/ttyACM4']
+# The port of the gateway can be given, for example the one of fake_gateway.py
+if os.environ.get("LIGHT_MONITOR_PORT"):
+    nameList.insert(0, os.environ["LIGHT_MONITOR_PORT"])
 port_connected = False
-ansi_escape = re.compile(r'\x1b(\[[0-?]*[ -/]*[@-~]?|[ -/]*[@-~])')
 
 for each in nameList:
     print(each)
@@ -52,14 +64,27 @@ if port_connected == False:
     print("No port responded, ending program")
     quit()
 
+def read_nodes():
+    """Nodes are stored one per line as: <node> [site/building/floor/zone]"""
+    with open('data/nodes_file.txt', 'r') as openfile:
+        return [line.split() for line in openfile.readlines() if line.strip()]
+
 nodes_list = []
-with open('data/nodes_file.txt', 'r') as openfile:
-    nodes_list = [line.strip() for line in openfile.readlines()]
+for node in read_nodes():
+    nodes_list.append(node[0])
+    rollup.place(node[0], node[1] if len(node) > 1 else None)
      
+def read_zones():
+    """Zones are stored one per line as: <group address> <node> <node> ..."""
+    try:
+        with open('data/zones_file.txt', 'r') as openfile:
+            return [line.split() for line in openfile.readlines() if line.strip()]
+    except FileNotFoundError:
+        return []
+
 def generate_nodes():
-    with open('data/nodes_file.txt', 'r') as openfile:
-        nodes_list = [line.strip() for line in openfile.readlines()]
-    return {node: 'No response' for node in nodes_list}
+    rollup.reset()
+    return {node[0]: 'No response' for node in read_nodes()}
 
 
 @app.route("/")
@@ -88,6 +113,9 @@ def get_result_updates():
             sentence = serial_buffer_result.get(block=False)
             name, response = sentence.split()[1:]
             output[name] = response
+        # A whole sweep is applied at once
+        while not serial_buffer_sweep.empty():
+            output.update(serial_buffer_sweep.get(block=False))
             
     except queue.Empty:
         print("Empty")
@@ -111,6 +139,41 @@ def get_logged_results():
 
     return jsonify(Log_dict)
 
+def sweep_to_dict(line):
+    """sweep <roster crc> <start> <end> <nodes> <pass> <fail> <missing>
+    None if the record is for another roster."""
+    crc, start, end, count, passed, failed, missing = line.split()[1:8]
+    output = {}
+    for state, bitmap in (("passed", passed), ("failed", failed), ("No response", missing)):
+        nodes = roster_bitmap_nodes(crc, int(count), bitmap)
+        if nodes is None:
+            print("Sweep summary is for another roster, ignored")
+            return None
+        for node in nodes:
+            output[node] = state
+    return output
+
+def roster_of(crc, count):
+    """The roster a record of the gateway is indexed by, or None if the
+    gateway has another roster."""
+    roster = nodes_list[:count]
+    if count != len(roster):
+        return None
+    packed = struct.pack("<%dH" % count, *[int(node) for node in roster])
+    if zlib.crc32(packed) != int(crc, 16):
+        return None
+    return roster
+
+def roster_bitmap_nodes(crc, count, bitmap):
+    """Nodes whose bit is set in a bitmap indexed by roster position, or None
+    if the bitmap is for another roster."""
+    roster = roster_of(crc, count)
+    if roster is None:
+        return None
+
+    bits = bytes.fromhex(bitmap) if count else b""
+    return [node for idx, node in enumerate(roster) if bits[idx // 8] & (1 << (idx % 8))]
+
 def log_to_dict(dict, result, timestamp, node):
     timestamp = str(datetime.fromtimestamp(int(timestamp))) 
 
@@ -129,7 +192,9 @@ def log_to_dict(dict, result, timestamp, node):
 def request_status():
 
     ser.write(clear.encode("utf-8"))
-    msg = "monitor status\n"
+    # The gateway answers from its cache, only nodes older than maxAge are asked
+    max_age = request.args.get('maxAge', type=int)
+    msg = "monitor status\n" if max_age is None else "monitor status {}\n".format(max_age)
     ser.write(msg.encode("utf-8"))
     return []
 
@@ -175,6 +240,52 @@ def calibrate():
     return []
 
 
+@app.route("/calibrate_all")
+def calibrate_all():
+    """Calibrate every node of the roster, the gateway reports once when done."""
+    ser.write(clear.encode("utf-8"))
+    ser.write("monitor calibrate_all\n".encode("utf-8"))
+    return []
+
+
+@app.route("/get_calibration")
+def get_calibration():
+    """Summary of the last calibration of the whole roster, empty until one ends."""
+    return jsonify(last_calibration)
+
+
+@app.route("/commission")
+def commission():
+    """Let the gateway provision and configure the nodes that beacon during
+    the given time. The configured nodes are added to the roster as they come."""
+    seconds = request.args.get('seconds', default=60, type=int)
+    ser.write(clear.encode("utf-8"))
+    ser.write(("monitor prov_scan " + str(seconds) + "\n").encode("utf-8"))
+    commissioning.update(running=True, provisioned=0, configured=0, failed=0)
+    commissioning["events"].clear()
+    return []
+
+
+@app.route("/get_commissioning")
+def get_commissioning():
+    """Counts of the running or last commissioning, and its latest events."""
+    return jsonify(dict(commissioning, events=list(commissioning["events"])))
+
+
+@app.route("/get_battery")
+def get_battery():
+    """Supply and switchover of every node in its last test, lowest battery first."""
+    return jsonify(sorted(({"node": node, **stats} for node, stats in battery.items()),
+                          key=lambda entry: (entry["battMv"] is None, entry["battMv"] or 0)))
+
+
+@app.route("/get_links")
+def get_links():
+    """Link quality of every node the gateway has exported, weakest first."""
+    return jsonify(sorted(({"node": node, **stats} for node, stats in link_stats.items()),
+                          key=lambda entry: -entry["weakness"]))
+
+
 @app.route("/request_test")
 def request_test_start():
     dt = datetime.now()
@@ -185,42 +296,350 @@ def request_test_start():
     return jsonify(generate_nodes())  
 
 
+@app.route("/request_campaign")
+def request_campaign():
+    zones = read_zones()
+    if not zones:
+        return jsonify({"error": "no zones configured in data/zones_file.txt"}), 400
+
+    ts = int(datetime.timestamp(datetime.now()))
+    duration = request.args.get('durationValue', default=60, type=int)
+    max_concurrent = request.args.get('maxConcurrent', default=len(nodes_list), type=int)
+
+    ser.write(clear.encode("utf-8"))
+    ser.write("monitor zone_reset\n".encode("utf-8"))
+    for idx, zone in enumerate(zones):
+        time.sleep(0.1)
+        msg = "monitor zone " + str(idx) + " " + zone[0] + "\n"
+        ser.write(msg.encode("utf-8"))
+        for node in zone[1:]:
+            time.sleep(0.1)
+            msg = "monitor zone_node " + str(idx) + " " + node + "\n"
+            ser.write(msg.encode("utf-8"))
+
+    msg = "monitor campaign " + str(duration) + " " + str(ts) + " " + str(max_concurrent) + "\n"
+    ser.write(msg.encode("utf-8"))
+    return jsonify(generate_nodes())
+
+
+@app.route("/set_schedule")
+def set_schedule():
+    """Hand the monthly functional and yearly duration tests over to the nodes.
+    Each node gets its own offset so they don't all test at the same time."""
+    fn_period = request.args.get('fnPeriod', default=30, type=int)
+    fn_duration = request.args.get('fnDuration', default=30, type=int)
+    full_period = request.args.get('fullPeriod', default=365, type=int)
+    full_duration = request.args.get('fullDuration', default=180, type=int)
+    offset_step = request.args.get('offsetStep', default=10, type=int)
+
+    ser.write(clear.encode("utf-8"))
+    for idx, node in enumerate(nodes_list):
+        time.sleep(0.1)
+        msg = "monitor schedule {} {} {} {} {} {}\n".format(
+            node, fn_period, fn_duration, full_period, full_duration, (idx * offset_step) % 65536)
+        ser.write(msg.encode("utf-8"))
+    return jsonify(nodes_list)
+
+
 def serial_data_buffer():
     get_nodes = 8
     ser.write(get_nodes.to_bytes(1, byteorder='big'))
     set_nodes_list()
+    # The gateway is the time authority of the mesh, give it the host time
+    ts = int(datetime.timestamp(datetime.now()))
+    ser.write(("monitor time " + str(ts) + "\n").encode("utf-8"))
+    # Get the results the gateway stored while we were away
+    ser.write(("monitor replay " + str(read_stored_seq()) + "\n").encode("utf-8"))
     
-    while True:
-        try:
-            raw_data = ser.readline()
-            line = raw_data.decode("utf-8").strip()
-            line = line.replace("uart:~$", "")
-            line = line.lstrip("IJ")
-            line = ansi_escape.sub('', line).strip()
-            if line.startswith("result"):
-                serial_buffer_result.put(line, timeout=1)
-            elif line.startswith("status"):
-                serial_buffer_status.put(line, timeout=1)
-            elif line.startswith("acking"):
-                serial_buffer_result.put(line, timeout=1)
-                node_name = line[7:].split(" ")[0]
-                if node_name not in nodes_list:
-                    nodes_list.append(node_name)
-                    store_node(node_name)
-            elif line.startswith("nodeok"):
-                node_name = line[7:].split(" ")[0]
-                print("got node " + node_name)
-                if node_name not in nodes_list:
-                    print("added to nodes list", node_name)
-                    store_node(node_name)
-                    nodes_list.append(node_name)
-            elif line.startswith("logged"):
-                serial_buffer_log.put(line[7:], timeout=1)
-            elif line and not line.isspace():
-                print(line)
-                
-        except UnicodeDecodeError:
-            print("Got something we could not read")
+    asyncio.run(pipeline.run())
+
+def result_time(time_stamp):
+    """Results are filed under the gateway's timestamp, so a result read
+    live, in a sweep record and again from a replay is kept once. The host
+    clock only stands in for a gateway that had no time yet (0)."""
+    time_stamp = int(time_stamp)
+    return time_stamp if time_stamp else int(time.time())
+
+def on_result(line):
+    node_name, response, time_stamp = line.split()[1:4]
+    history.add(node_name, result_time(time_stamp), response == "passed")
+    record_read()
+    rollup.set_state(node_name, response)
+    return [("result", "result {} {}".format(node_name, response))]
+
+def on_sweep(line):
+    results = sweep_to_dict(line)
+    if results is None:
+        return []
+    # The gateway stamps the results of a sweep with its start
+    start = result_time(line.split()[2])
+    for node_name, response in results.items():
+        if response != "No response":
+            history.add(node_name, start, response == "passed")
+        rollup.set_state(node_name, response if response != "No response" else "missing")
+    record_read()
+    return [("sweep", results)]
+
+# Summary of the last calibration of the whole roster
+last_calibration = {}
+
+def on_calibration(line):
+    """calibration <roster crc> <seconds> <nodes> <calibrated> <missing>
+    <threshold min> <threshold max> <noise max> <noisiest node>"""
+    global last_calibration
+    crc, seconds, count, calibrated, missing, low, high, noise, noisiest = line.split()[1:10]
+    missing_nodes = roster_bitmap_nodes(crc, int(count), missing)
+    if missing_nodes is None:
+        print("Calibration summary is for another roster, ignored")
+        return []
+
+    last_calibration = {
+        "seconds": int(seconds),
+        "nodes": int(count),
+        "calibrated": int(calibrated),
+        "missing": missing_nodes,
+        "thresholdMin": int(low),
+        "thresholdMax": int(high),
+        "noiseMax": int(noise),
+        "noisiest": noisiest,
+    }
+    print(last_calibration)
+    return []
+
+# Progress of the commissioning by the gateway
+commissioning = {"running": False, "provisioned": 0, "configured": 0, "failed": 0,
+                 "events": deque(maxlen=50)}
+
+def on_commissioning(line):
+    """provisioning <uuid>, provisioned <addr> <uuid>, provision failed <uuid>,
+    configured <addr>, configure failed <addr> <err>"""
+    words = line.split()
+    commissioning["events"].append(line)
+    if words[0] == "provisioned":
+        commissioning["provisioned"] += 1
+    elif words[1] == "failed":
+        commissioning["failed"] += 1
+    elif words[0] == "configured":
+        commissioning["configured"] += 1
+        node_name = words[1]
+        if node_name not in nodes_list:
+            ser.write((("monitor add_node " if nodes_list else "monitor add_first_node ") +
+                       node_name + "\n").encode("utf-8"))
+            nodes_list.append(node_name)
+            store_node(node_name)
+            rollup.place(node_name)
+    return []
+
+def on_commission(line):
+    """commission done <provisioned> <configured> <failed>"""
+    provisioned, configured, failed = line.split()[2:5]
+    commissioning.update(running=False, provisioned=int(provisioned),
+                         configured=int(configured), failed=int(failed))
+    commissioning["events"].append(line)
+    return []
+
+# Link quality of every node, by node
+link_stats = {}
+
+def link_weakness(rssi, hops, rate, retries):
+    """0 for a good link, 1 for a node about to drop out: the worst of a
+    weak last hop, unanswered requests and repeated requests."""
+    scores = [min(retries / 8, 1)]
+    if rssi is not None:
+        scores.append(min(max((-70 - rssi) / 25, 0), 1))
+    if rate is not None:
+        scores.append(1 - rate / 100)
+    return round(max(scores), 2)
+
+def on_links(line):
+    """links <roster crc> <nodes> <first index> <entries>, 4 bytes per node:
+    RSSI (signed, -128 unknown), hops (0 unknown), reply rate in percent
+    (255 unknown), retries"""
+    crc, count, first, entries = line.split()[1:5]
+    roster = roster_of(crc, int(count))
+    if roster is None:
+        print("Link statistics are for another roster, ignored")
+        return []
+
+    first = int(first)
+    for idx, (rssi, hops, rate, retries) in enumerate(
+            struct.iter_unpack("<bBBB", bytes.fromhex(entries))):
+        rssi = None if rssi == -128 else rssi
+        hops = hops or None
+        rate = None if rate == 255 else rate
+        link_stats[roster[first + idx]] = {
+            "rssi": rssi,
+            "hops": hops,
+            "replyRate": rate,
+            "retries": retries,
+            "weakness": link_weakness(rssi, hops, rate, retries),
+        }
+    return []
+
+# Lowest supply and battery voltages and switchover time of the last test, by node
+battery = {}
+
+def on_supply(line):
+    """supply <node> <lowest vdd mV> <lowest battery mV>, seen during the last test"""
+    node_name, vdd_mv, batt_mv = line.split()[1:4]
+    battery.setdefault(node_name, {"switchoverUs": None}).update(
+        vddMv=int(vdd_mv), battMv=int(batt_mv))
+    return []
+
+def on_switchover(line):
+    """switchover <node> <us from mains loss to light>, - if the light never came"""
+    node_name, delay = line.split()[1:3]
+    battery.setdefault(node_name, {"vddMv": None, "battMv": None})["switchoverUs"] = (
+        None if delay == "-" else int(delay))
+    return []
+
+def on_status(line):
+    return [("status", line)]
+
+def on_lux(line):
+    # Sensor Server reading, in lux instead of the LDR resistance
+    node_name, lux = line.split()[1:3]
+    return [("status", "status {} {}lx".format(node_name, lux))]
+
+def on_progress(line):
+    # Shown in place of the result until the test finishes:
+    # progress <node> <elapsed> <darkest> <current> <margin>
+    node_name, elapsed, darkest, current, margin = line.split()[1:6]
+    return [("result", "progress {} {}s,margin:{}".format(node_name, elapsed, margin))]
+
+def on_acking(line):
+    node_name = line.split()[1]
+    if node_name not in nodes_list:
+        nodes_list.append(node_name)
+        store_node(node_name)
+        rollup.place(node_name)
+    return [("result", line)]
+
+def on_nodeok(line):
+    node_name = line.split()[1]
+    print("got node " + node_name)
+    if node_name not in nodes_list:
+        print("added to nodes list", node_name)
+        store_node(node_name)
+        nodes_list.append(node_name)
+        rollup.place(node_name)
+
+def on_logged(line):
+    """logged <result> <timestamp> <node> [reported], replays of the gateway's
+    ring have no reported field"""
+    result, timestamp, node_name, *reported = line.split()[1:5]
+    # The gateway already filed a result it acknowledged, under its own clock,
+    # the entry is only shown in the log of the node
+    if reported != ["1"]:
+        history.add(node_name, result_time(timestamp), result == "1")
+        record_read()
+    return [("log", "{} {} {}".format(result, timestamp, node_name))]
+
+# Sequence number of the last result stored by the gateway that was processed
+stored_seq = None
+# The gateway prints a stored line after every result, log entry and sweep
+# record it keeps in its ring. Records that made it to the history and
+# weren't acknowledged yet are counted, and a stored line with none to
+# acknowledge means its record was dropped on the way. From then on
+# stored_seq stays put, so the next replay brings the record back.
+records_read = 0
+record_lost = False
+
+def record_read():
+    global records_read
+    records_read += 1
+
+def read_stored_seq():
+    try:
+        with open('data/stored_seq.txt', 'r') as openfile:
+            return int(openfile.read().strip() or 0)
+    except (FileNotFoundError, ValueError):
+        return 0
+
+def on_stored(line):
+    global stored_seq, records_read, record_lost
+    if records_read == 0 and not record_lost:
+        print("Result stored by the gateway was not read, it is replayed on the next start")
+        record_lost = True
+    records_read = max(records_read - 1, 0)
+    if not record_lost:
+        stored_seq = max(stored_seq or 0, int(line.split()[1]))
+
+def after_batch():
+    """The results of the batch are in the history, they can be acknowledged."""
+    history.flush()
+    if stored_seq is not None:
+        with open('data/stored_seq.txt', 'w') as outfile:
+            outfile.write(str(stored_seq))
+
+def on_other(line):
+    print(line)
+
+pipeline = ingest.Pipeline(ser, {
+    "result": on_result,
+    "sweep": on_sweep,
+    "calibration": on_calibration,
+    "links": on_links,
+    "status": on_status,
+    "supply": on_supply,
+    "switchover": on_switchover,
+    "lux": on_lux,
+    "progress": on_progress,
+    "acking": on_acking,
+    "nodeok": on_nodeok,
+    "logged": on_logged,
+    "stored": on_stored,
+    "provisioning": on_commissioning,
+    "provisioned": on_commissioning,
+    "provision": on_commissioning,
+    "configured": on_commissioning,
+    "configure": on_commissioning,
+    "commission": on_commission,
+    "default": on_other,
+}, {
+    "status": serial_buffer_status,
+    "result": serial_buffer_result,
+    "sweep": serial_buffer_sweep,
+    "log": serial_buffer_log,
+}, after_batch=after_batch)
+
+@app.route("/overview")
+def overview():
+    """Pass/fail/missing counts of one level of the site hierarchy and of its
+    children, path is the level as site/building/floor/zone."""
+    path = request.args.get('path', default="")
+    return jsonify(rollup.overview(path.split("/") if path else ()))
+
+@app.route("/report")
+def report():
+    """Test history of every fixture as CSV, streamed from the stored history.
+    Optional filters: from and to dates (YYYY-MM-DD, to is exclusive) and zone
+    (index in data/zones_file.txt)."""
+    def unix(arg):
+        date = request.args.get(arg)
+        return int(datetime.strptime(date, "%Y-%m-%d").timestamp()) if date else None
+
+    zones = read_zones()
+    zone_of = {int(node): idx for idx, zone in enumerate(zones) for node in zone[1:]}
+    nodes = None
+    zone = request.args.get('zone', type=int)
+    if zone is not None:
+        if zone < 0 or zone >= len(zones):
+            return jsonify({"error": "no zone " + str(zone)}), 400
+        nodes = {int(node) for node in zones[zone][1:]}
+
+    try:
+        start, end = unix('from'), unix('to')
+    except ValueError:
+        return jsonify({"error": "dates are YYYY-MM-DD"}), 400
+
+    return Response(stream_with_context(history.csv_report(start, end, nodes, zone_of)),
+                    mimetype="text/csv",
+                    headers={"Content-Disposition": "attachment; filename=report.csv"})
+
+@app.route("/pipeline_stats")
+def pipeline_stats():
+    return jsonify(pipeline.stats())
 
 def store_node(node):
     with open("data/nodes_file.txt", "a") as outfile:   
@@ -0,0 +1,453 @@
+"""Stand-in for the light_monitor_cli gateway board, for load-testing the webserver.
+
+Opens a pseudo-terminal that behaves like the gateway's shell, and simulates a
+site of N light monitor servers behind it:
+
+    python3 fake_gateway.py --nodes 2000 --loss 0.02 --fail-rate 0.01
+
+then start the webserver on the printed port:
+
+    LIGHT_MONITOR_PORT=/dev/pts/5 python3 emergency_light_tester.py
+
+A real site can be recorded by putting the fake gateway in front of the board,
+it passes the traffic through and writes everything the board prints with its
+time to the capture file:
+
+    python3 fake_gateway.py --record site.txt --port /dev/ttyACM0
+
+and replayed later, optionally faster than real time:
+
+    python3 fake_gateway.py --replay site.txt --speed 10
+
+Nodes that aren't commissioned yet are simulated with --unprovisioned, they
+join the site when the webserver commissions them.
+"""
+import argparse
+import heapq
+import os
+import random
+import select
+import struct
+import sys
+import time
+import tty
+import zlib
+
+# Calibration of the gateway firmware, see light_monitor_cli/Kconfig
+CALIBRATION_REPLY_RATE = 20
+CALIBRATION_RETRIES = 2
+CALIBRATION_SETTLE = 3
+# Time of one provisioning link, and of the configuration of one node (s)
+PROVISION_TIME = 2.0
+CONFIGURE_TIME = 1.5
+# Export period of the link statistics (s)
+LINK_STATS_PERIOD = 60
+
+
+def roster_crc(roster):
+    return zlib.crc32(struct.pack("<%dH" % len(roster), *roster))
+
+
+def roster_bitmap(roster, test):
+    """Hex bitmap of the roster positions whose address passes test."""
+    bits = bytearray((len(roster) + 7) // 8)
+    for idx, addr in enumerate(roster):
+        if test(addr):
+            bits[idx // 8] |= 1 << (idx % 8)
+    return bits.hex() if roster else "-"
+
+
+class FakeGateway:
+    def __init__(self, fd, args):
+        self.fd = fd
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.site = [args.first_addr + i for i in range(args.nodes)]
+        self.failing = {addr for addr in self.site if self.rng.random() < args.fail_rate}
+        self.roster = []
+        self.events = []
+        self.sequence = 0
+        self.sweep = None
+        self.calibrating = False
+        self.commissioning = False
+        self.unprovisioned = [os.urandom(16).hex() for _ in range(args.unprovisioned)]
+        self.clock = None
+        self.at(LINK_STATS_PERIOD, self.links_export)
+
+    def write(self, line):
+        os.write(self.fd, (line + "\r\n").encode("utf-8"))
+
+    def at(self, delay, action, *params):
+        """Run action(*params) delay seconds of simulated time from now."""
+        self.sequence += 1
+        heapq.heappush(self.events, (time.monotonic() + delay / self.args.time_scale,
+                                     self.sequence, action, params))
+
+    def run_due(self):
+        while self.events and self.events[0][0] <= time.monotonic():
+            _, _, action, params = heapq.heappop(self.events)
+            action(*params)
+
+    def timeout(self):
+        if not self.events:
+            return None
+        return max(self.events[0][0] - time.monotonic(), 0)
+
+    def lost(self):
+        return self.rng.random() < self.args.loss
+
+    def latency(self, mean):
+        return self.rng.expovariate(1 / mean) if mean > 0 else 0
+
+    def now(self):
+        return int(self.clock + time.monotonic()) if self.clock else 0
+
+    def node_result(self, addr):
+        passed = addr not in self.failing
+        if self.sweep is not None:
+            # Only the sweep record reports the results of a sweep
+            if addr in self.sweep:
+                self.sweep[addr] = passed
+        else:
+            self.write("result {} {} {}".format(
+                addr, "passed" if passed else "failed", self.now()))
+        self.write("supply {} 3000 {}".format(addr, 2900 if passed else 2100))
+        self.write("switchover {} {}".format(
+            addr, self.rng.randrange(200, 400000, 200) if passed else "-"))
+
+    def sweep_done(self, start, campaign):
+        roster = self.roster
+        results = self.sweep
+        self.sweep = None
+
+        def bitmap(test):
+            return roster_bitmap(roster, lambda addr: test(results[addr]))
+
+        if campaign:
+            self.write("campaign done")
+        self.write("sweep {:08x} {} {} {} {} {} {}".format(
+            roster_crc(roster), start, self.now(), len(roster), bitmap(lambda res: res is True),
+            bitmap(lambda res: res is False), bitmap(lambda res: res is None)))
+
+    def threshold(self, addr):
+        return 2000 + addr % 1000
+
+    def calibrate_all(self):
+        """One group request, then the retry rounds of the nodes that didn't answer."""
+        if self.calibrating:
+            self.write("Could not start the calibration (err -16)")
+            return
+        if not self.roster:
+            self.write("Could not start the calibration (err -2)")
+            return
+
+        roster = list(self.roster)
+        site = set(self.site)
+        calibrated = [addr for addr in roster if addr in site and any(
+            not self.lost() for _ in range(1 + CALIBRATION_RETRIES))]
+        # The nodes answer at the reply rate, the missing ones are asked once per round
+        duration = len(roster) / CALIBRATION_REPLY_RATE + CALIBRATION_SETTLE
+        if len(calibrated) < len(roster):
+            duration += CALIBRATION_RETRIES * (
+                (len(roster) - len(calibrated)) * 0.25 + CALIBRATION_SETTLE)
+        self.calibrating = True
+        self.at(duration, self.calibration_done, roster, calibrated, int(duration))
+
+    def calibration_done(self, roster, calibrated, duration):
+        self.calibrating = False
+        noise = {addr: self.rng.randint(5, 80) for addr in calibrated}
+        thresholds = [self.threshold(addr) for addr in calibrated] or [0]
+        noisiest = max(noise, key=noise.get) if noise else 0
+        self.write("calibration {:08x} {} {} {} {} {} {} {} {}".format(
+            roster_crc(roster), duration, len(roster), len(calibrated),
+            roster_bitmap(roster, lambda addr: addr not in noise), min(thresholds),
+            max(thresholds), noise.get(noisiest, 0), noisiest))
+
+    def links(self):
+        """Link statistics of the roster, 32 nodes per line."""
+        roster = self.roster
+        for first in range(0, len(roster), 32):
+            entries = b""
+            for addr in roster[first:first + 32]:
+                if addr not in self.site:
+                    entries += struct.pack("<bBBB", -128, 0, 255, 0)
+                    continue
+                # The far nodes are heard through weaker relays and miss more
+                hops = 1 + addr % 4
+                rate = max(0, min(100, int(100 * (1 - self.args.loss) ** hops) -
+                                  self.rng.randint(0, 5 * hops)))
+                entries += struct.pack("<bBBB", -40 - 10 * hops - self.rng.randint(0, 15),
+                                       hops, rate, (100 - rate) // 10)
+            self.write("links {:08x} {} {} {}".format(roster_crc(roster), len(roster), first,
+                                                      entries.hex()))
+
+    def links_export(self):
+        self.links()
+        self.at(LINK_STATS_PERIOD, self.links_export)
+
+    def tx_tune(self):
+        """Hop survey of the roster, then the verified settings of every node."""
+        roster = [addr for addr in self.roster if addr]
+        base = 2 if len(roster) <= 64 else 1 if len(roster) <= 512 else 0
+        delay = len(roster) * self.args.ack_latency
+        for addr in roster:
+            self.write("topology {} {} -{} 0".format(addr, 1 + addr % 4, self.rng.randint(40, 90)))
+        self.write("topology done")
+        tuned = failed = 0
+        for addr in roster:
+            hops = 1 + addr % 4
+            if self.lost():
+                failed += 1
+                self.at(delay, self.write, "transmit failed {} -116".format(addr))
+            else:
+                tuned += 1
+                pub = min(max(base, 1) + (hops - 2) // 2, 2) if hops > 1 else 0
+                self.at(delay, self.write, "transmit {} {} {} {}".format(
+                    addr, min(base + hops // 2, 3), max(base, 1), pub))
+        self.at(delay, self.write, "transmit done {} {} {}".format(len(roster), tuned, failed))
+
+    def prov_scan(self, seconds):
+        """One provisioning link at a time, each node is configured while the
+        next one is provisioned."""
+        if self.commissioning:
+            self.write("Could not start the commissioning (err -16)")
+            return
+
+        self.commissioning = True
+        counts = {"provisioned": 0, "configured": 0, "failed": 0}
+        link_free = config_free = 0
+        next_addr = max(self.site + [self.args.first_addr - 1]) + 1
+        for uuid in list(self.unprovisioned):
+            heard = self.rng.uniform(0, 5)
+            if heard > seconds:
+                continue
+            start = max(link_free, heard)
+            link_free = start + PROVISION_TIME
+            self.at(start, self.write, "provisioning " + uuid)
+            if self.lost():
+                self.at(link_free, self.provision_failed, uuid, counts)
+                continue
+            self.unprovisioned.remove(uuid)
+            self.at(link_free, self.provisioned, next_addr, uuid, counts)
+            config_free = max(config_free, link_free) + CONFIGURE_TIME
+            self.at(config_free, self.configured, next_addr, counts)
+            next_addr += 1
+        self.at(max(seconds, link_free, config_free), self.commission_done, counts)
+
+    def provision_failed(self, uuid, counts):
+        counts["failed"] += 1
+        self.write("provision failed " + uuid)
+
+    def provisioned(self, addr, uuid, counts):
+        counts["provisioned"] += 1
+        self.write("provisioned {} {}".format(addr, uuid))
+
+    def configured(self, addr, counts):
+        counts["configured"] += 1
+        self.site.append(addr)
+        self.write("configured {}".format(addr))
+
+    def commission_done(self, counts):
+        self.commissioning = False
+        self.write("commission done {provisioned} {configured} {failed}".format(**counts))
+
+    def test(self, duration, campaign=False):
+        if self.sweep is not None:
+            self.write("Test is already running ")
+            return
+
+        self.sweep = {addr: None for addr in self.roster}
+        for addr in self.site:
+            if self.lost():
+                continue
+            self.at(self.latency(self.args.ack_latency), self.write,
+                    "acking {} waiting".format(addr))
+            for elapsed in range(self.args.progress_step, duration, self.args.progress_step):
+                self.at(elapsed, self.write, "progress {} {} 900 850 2650".format(addr, elapsed))
+            if not self.lost():
+                self.at(duration + self.latency(self.args.result_latency), self.node_result, addr)
+        self.at(duration + 4 * self.args.result_latency + 1, self.sweep_done, self.now(), campaign)
+
+    def command(self, line):
+        words = line.split()
+        if len(words) < 2 or words[0] != "monitor":
+            if words:
+                self.write("{}: command not found".format(words[0]))
+            return
+
+        cmd, params = words[1], words[2:]
+        if cmd == "portok":
+            self.write("PORTOK")
+        elif cmd == "reset_nodes":
+            self.roster = []
+        elif cmd in ("add_first_node", "add_node"):
+            self.roster.append(int(params[0], 0))
+        elif cmd == "nodeslist":
+            for addr in self.roster:
+                self.write("nodeok {}".format(addr))
+        elif cmd == "time":
+            self.clock = int(params[0]) - time.monotonic()
+        elif cmd == "start":
+            self.clock = int(params[1]) - time.monotonic()
+            self.test(int(params[0]))
+        elif cmd == "campaign":
+            self.clock = int(params[1]) - time.monotonic()
+            self.test(int(params[0]), campaign=True)
+        elif cmd in ("zone_reset", "zone", "zone_node", "sensor_cadence", "relay_restore", "replay"):
+            pass
+        elif cmd == "status":
+            for addr in self.site:
+                if not self.lost():
+                    self.at(self.latency(self.args.ack_latency), self.write,
+                            "status {} {}".format(addr, self.rng.randint(500, 1500)))
+        elif cmd == "log":
+            addr = int(params[0], 0)
+            for age in range(8):
+                stamp = (self.now() // 60 - age * 43200) * 60
+                self.at(self.latency(self.args.ack_latency), self.write,
+                        "logged {} {} {} 0".format(int(addr not in self.failing), stamp, addr))
+        elif cmd == "calibrate" and self.calibrating:
+            self.write("Could not calibrate the node (err -16)")
+        elif cmd == "calibrate":
+            addr = int(params[0], 0)
+            self.at(self.latency(self.args.ack_latency), self.write,
+                    "calibrated {} {} {}".format(addr, self.threshold(addr),
+                                                 self.rng.randint(5, 80)))
+        elif cmd == "calibrate_all":
+            self.calibrate_all()
+        elif cmd == "links" and not self.roster:
+            self.write("Could not print the link statistics (err -2)")
+        elif cmd == "links":
+            self.links()
+        elif cmd == "tx_tune":
+            self.tx_tune()
+        elif cmd == "prov_create":
+            # The simulated gateway is part of a network already
+            self.write("Could not create the network (err -120)")
+        elif cmd == "prov_scan":
+            self.prov_scan(int(params[0]))
+        elif cmd == "schedule":
+            self.at(self.latency(self.args.ack_latency), self.write,
+                    "schedule " + " ".join(params))
+        elif cmd == "time_get":
+            self.write("time {} {} 0".format(params[0], self.now()))
+        else:
+            self.write("monitor: {} unknown parameter".format(cmd))
+
+
+def shell_lines(fd, pending):
+    """Read what the host typed, returns the complete lines and the rest."""
+    data = pending + os.read(fd, 4096)
+    lines = data.replace(b"\r", b"\n").split(b"\n")
+    return [line.decode("utf-8", "replace").strip("\x08 ") for line in lines[:-1]], lines[-1]
+
+
+def simulate(master, args):
+    gateway = FakeGateway(master, args)
+    pending = b""
+    while True:
+        ready, _, _ = select.select([master], [], [], gateway.timeout())
+        if ready:
+            lines, pending = shell_lines(master, pending)
+            for line in lines:
+                # The shell echoes what it is given
+                gateway.write(line)
+                if line:
+                    gateway.command(line)
+        gateway.run_due()
+
+
+def record(master, args):
+    import serial
+
+    board = serial.Serial(args.port, 115200, timeout=0)
+    start = time.monotonic()
+    with open(args.record, "w") as capture:
+        out = b""
+        while True:
+            ready, _, _ = select.select([master, board.fileno()], [], [])
+            if master in ready:
+                board.write(os.read(master, 4096))
+            if board.fileno() in ready:
+                data = board.read(board.in_waiting or 1)
+                os.write(master, data)
+                *lines, out = (out + data).split(b"\n")
+                for line in lines:
+                    capture.write("{:.3f} {}\n".format(
+                        time.monotonic() - start,
+                        line.decode("utf-8", "replace").rstrip("\r")))
+                capture.flush()
+
+
+def replay(master, args):
+    with open(args.replay) as capture:
+        entries = [line.rstrip("\n").split(" ", 1) for line in capture if " " in line]
+
+    gateway = FakeGateway(master, args)
+    pending = b""
+    # Wait for the webserver to find the port before playing the capture
+    while True:
+        select.select([master], [], [])
+        lines, pending = shell_lines(master, pending)
+        if any("portok" in line for line in lines):
+            gateway.write("PORTOK")
+            break
+
+    start = time.monotonic()
+    for stamp, line in entries:
+        delay = start + float(stamp) / args.speed - time.monotonic()
+        ready, _, _ = select.select([master], [], [], max(delay, 0))
+        if ready:
+            # Commands are not simulated, only drained
+            _, pending = shell_lines(master, pending)
+            delay = start + float(stamp) / args.speed - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        os.write(master, (line + "\r\n").encode("utf-8"))
+    print("Replay done")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--nodes", type=int, default=100, help="number of simulated nodes")
+    parser.add_argument("--first-addr", type=int, default=2, help="address of the first node")
+    parser.add_argument("--ack-latency", type=float, default=0.5,
+                        help="mean time for a node to answer a command (s)")
+    parser.add_argument("--result-latency", type=float, default=2.0,
+                        help="mean time for a result to reach the gateway (s)")
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="probability that a message of a node is lost")
+    parser.add_argument("--fail-rate", type=float, default=0.0,
+                        help="probability that a node fails its tests")
+    parser.add_argument("--progress-step", type=int, default=300,
+                        help="progress record period during a test (s)")
+    parser.add_argument("--time-scale", type=float, default=1.0,
+                        help="simulated seconds per real second, to shorten the tests")
+    parser.add_argument("--unprovisioned", type=int, default=0,
+                        help="number of nodes waiting to be commissioned")
+    parser.add_argument("--seed", type=int, default=None, help="seed of the simulation")
+    parser.add_argument("--record", help="pass the traffic of --port through, and record it")
+    parser.add_argument("--port", default="/dev/ttyACM0", help="board to record")
+    parser.add_argument("--replay", help="play a recorded capture instead of simulating")
+    parser.add_argument("--speed", type=float, default=1.0, help="replay speed factor")
+    args = parser.parse_args()
+
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    print("Fake gateway on", os.ttyname(slave))
+    sys.stdout.flush()
+
+    try:
+        if args.record:
+            record(master, args)
+        elif args.replay:
+            replay(master, args)
+        else:
+            simulate(master, args)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+"""Result history of every fixture, kept on disk for the compliance reports.
+
+Results are buffered as they are ingested and written in one transaction per
+ingestion batch. Reports are read back with a cursor, a few rows at a time, so
+they take the same memory whatever the size of the history.
+"""
+import csv
+import io
+import sqlite3
+import threading
+import time
+
+HISTORY_FILE = "data/history.db"
+FETCH_SIZE = 500
+
+_pending = []
+_lock = threading.Lock()
+
+
+def _connect():
+    db = sqlite3.connect(HISTORY_FILE)
+    db.execute("""CREATE TABLE IF NOT EXISTS results (
+                      node INTEGER NOT NULL,
+                      timestamp INTEGER NOT NULL,
+                      result INTEGER NOT NULL,
+                      PRIMARY KEY (node, timestamp)) WITHOUT ROWID""")
+    db.execute("CREATE INDEX IF NOT EXISTS results_by_time ON results (timestamp)")
+    return db
+
+
+def add(node, timestamp, passed):
+    """Queue a result, written with the next flush()."""
+    with _lock:
+        _pending.append((int(node), int(timestamp), int(passed)))
+
+
+def flush():
+    """Write the queued results. The same result logged twice is kept once."""
+    with _lock:
+        rows = _pending[:]
+        del _pending[:]
+    if not rows:
+        return
+    db = _connect()
+    with db:
+        db.executemany("INSERT OR IGNORE INTO results VALUES (?, ?, ?)", rows)
+    db.close()
+
+
+def rows(start=None, end=None, nodes=None):
+    """Yield (node, timestamp, passed) ordered by node then time.
+
+    start and end are Unix times, nodes an optional set of node addresses.
+    """
+    query = "SELECT node, timestamp, result FROM results WHERE timestamp >= ? AND timestamp < ?"
+    params = [start or 0, end or 2 ** 63 - 1]
+    if nodes is not None and len(nodes) <= 500:
+        query += " AND node IN ({})".format(",".join("?" * len(nodes)))
+        params += sorted(nodes)
+    query += " ORDER BY node, timestamp"
+
+    db = _connect()
+    try:
+        cursor = db.execute(query, params)
+        while True:
+            batch = cursor.fetchmany(FETCH_SIZE)
+            if not batch:
+                break
+            for node, timestamp, result in batch:
+                # Large zones are filtered here rather than in the query
+                if nodes is None or node in nodes:
+                    yield node, timestamp, bool(result)
+    finally:
+        db.close()
+
+
+def csv_report(start=None, end=None, nodes=None, zone_of=None):
+    """Yield the report as CSV text, a chunk of rows at a time."""
+    out = io.StringIO()
+    writer = csv.writer(out)
+    writer.writerow(["node", "zone", "date", "result"])
+    for count, (node, timestamp, passed) in enumerate(rows(start, end, nodes), 1):
+        writer.writerow([node, (zone_of or {}).get(node, ""),
+                         time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(timestamp)),
+                         "passed" if passed else "failed"])
+        if count % FETCH_SIZE == 0:
+            yield out.getvalue()
+            out.seek(0)
+            out.truncate()
+    yield out.getvalue()
@@ -0,0 +1,222 @@
+"""Staged ingestion of the gateway's serial output.
+
+The lines printed by the gateway go through five stages, each running as an
+asyncio task:
+
+    read -> frame -> parse -> apply -> fan-out
+
+The stages are connected by bounded queues. A full queue blocks the stage in
+front of it, so a slow stage stops the reader and the backlog stays in the
+serial driver instead of growing in memory. Only the fan-out to the HTTP
+endpoints drops data, as no browser may be polling them: a full sink drops its
+oldest entry and counts it.
+
+Every stage keeps the number of items it handled (bytes for the reader), and
+the mean and max time they waited in its queue and took to handle, see
+Pipeline.stats().
+"""
+import asyncio
+import queue
+import re
+import time
+
+STAGE_QUEUE_SIZE = 256
+# The apply stage handles the lines in batches, off the event loop
+APPLY_BATCH_SIZE = 64
+READ_SIZE = 4096
+
+ansi_escape = re.compile(r'\x1b(\[[0-?]*[ -/]*[@-~]?|[ -/]*[@-~])')
+
+
+class StageStats:
+    def __init__(self):
+        self.count = 0
+        self.wait_total = 0.0
+        self.wait_max = 0.0
+        self.busy_total = 0.0
+        self.busy_max = 0.0
+        self.dropped = 0
+
+    def record(self, queued, started, count=1):
+        now = time.monotonic()
+        wait = started - queued
+        busy = now - started
+        self.count += count
+        self.wait_total += wait * count
+        self.wait_max = max(self.wait_max, wait)
+        self.busy_total += busy
+        self.busy_max = max(self.busy_max, busy / count)
+
+    def as_dict(self, depth):
+        return {
+            "count": self.count,
+            "depth": depth,
+            "dropped": self.dropped,
+            "wait_mean_ms": 1000 * self.wait_total / self.count if self.count else 0,
+            "wait_max_ms": 1000 * self.wait_max,
+            "busy_mean_ms": 1000 * self.busy_total / self.count if self.count else 0,
+            "busy_max_ms": 1000 * self.busy_max,
+        }
+
+
+def clean_line(raw):
+    """Strip the shell prompt and escape codes from a line of the gateway."""
+    line = raw.decode("utf-8").strip()
+    line = line.replace("uart:~$", "")
+    line = line.lstrip("IJ")
+    return ansi_escape.sub('', line).strip()
+
+
+class Pipeline:
+    """Feeds the lines read from source to the handlers.
+
+    source is anything with read(size), like a serial port or a file opened
+    in binary mode. handlers maps the first word of a line to a function
+    taking the line and returning a list of (sink name, item) to publish, the
+    'default' handler gets all other lines. sinks maps a sink name to a
+    bounded queue.Queue read by the HTTP endpoints. after_batch is called once
+    the handlers are done with a batch, to commit what they stored.
+    """
+
+    def __init__(self, source, handlers, sinks, stop_on_eof=False, after_batch=None):
+        self.source = source
+        self.after_batch = after_batch
+        self.handlers = handlers
+        self.sinks = sinks
+        self.stop_on_eof = stop_on_eof
+        self.stages = ["read", "frame", "parse", "apply", "fanout"]
+        self.stats_by_stage = {stage: StageStats() for stage in self.stages}
+        self.sink_drops = {name: 0 for name in sinks}
+        self.queues = {}
+
+    def stats(self):
+        stats = {stage: self.stats_by_stage[stage].as_dict(
+                     self.queues[stage].qsize() if stage in self.queues else 0)
+                 for stage in self.stages}
+        stats["sinks"] = {name: {"depth": sink.qsize(), "dropped": self.sink_drops[name]}
+                          for name, sink in self.sinks.items()}
+        return stats
+
+    async def _read(self, out):
+        loop = asyncio.get_running_loop()
+        stats = self.stats_by_stage["read"]
+        while True:
+            # A serial port blocks until its timeout when asked for more than it has
+            size = getattr(self.source, "in_waiting", READ_SIZE) or 1
+            started = time.monotonic()
+            data = await loop.run_in_executor(None, self.source.read, min(size, READ_SIZE))
+            if not data:
+                if self.stop_on_eof:
+                    await out.put(None)
+                    return
+                continue
+            stats.record(started, started, len(data))
+            await out.put((time.monotonic(), data))
+
+    async def _frame(self, inp, out):
+        stats = self.stats_by_stage["frame"]
+        pending = b""
+        while True:
+            item = await inp.get()
+            if item is None:
+                await out.put(None)
+                return
+            queued, data = item
+            started = time.monotonic()
+            pending += data
+            *raw_lines, pending = pending.split(b"\n")
+            for raw in raw_lines:
+                try:
+                    line = clean_line(raw)
+                except UnicodeDecodeError:
+                    print("Got something we could not read")
+                    stats.dropped += 1
+                    continue
+                if line:
+                    await out.put((time.monotonic(), line))
+            stats.record(queued, started)
+
+    async def _parse(self, inp, out):
+        stats = self.stats_by_stage["parse"]
+        default = self.handlers.get("default")
+        while True:
+            item = await inp.get()
+            if item is None:
+                await out.put(None)
+                return
+            queued, line = item
+            started = time.monotonic()
+            handler = self.handlers.get(line.split(maxsplit=1)[0], default)
+            if handler:
+                await out.put((time.monotonic(), handler, line))
+            else:
+                stats.dropped += 1
+            stats.record(queued, started)
+
+    def _apply_batch(self, batch):
+        published = []
+        for _, handler, line in batch:
+            try:
+                published.extend(handler(line) or [])
+            except Exception as err:
+                # A malformed line must not stop the pipeline
+                print("Could not apply '{}': {!r}".format(line, err))
+                self.stats_by_stage["apply"].dropped += 1
+        if self.after_batch:
+            self.after_batch()
+        return published
+
+    async def _apply(self, inp, out):
+        loop = asyncio.get_running_loop()
+        stats = self.stats_by_stage["apply"]
+        while True:
+            batch = [await inp.get()]
+            while len(batch) < APPLY_BATCH_SIZE and not inp.empty():
+                batch.append(inp.get_nowait())
+            done = batch[-1] is None
+            batch = [item for item in batch if item is not None]
+            started = time.monotonic()
+            # Handlers may touch files, keep them off the event loop
+            published = await loop.run_in_executor(None, self._apply_batch, batch)
+            if batch:
+                # The wait of a batch is the one of its oldest line
+                stats.record(batch[0][0], started, len(batch))
+            if published:
+                await out.put((time.monotonic(), published))
+            if done:
+                await out.put(None)
+                return
+
+    async def _fanout(self, inp):
+        stats = self.stats_by_stage["fanout"]
+        while True:
+            item = await inp.get()
+            if item is None:
+                return
+            queued, published = item
+            started = time.monotonic()
+            for name, value in published:
+                self._publish(name, value)
+            stats.record(queued, started, len(published))
+
+    def _publish(self, name, value):
+        sink = self.sinks[name]
+        while True:
+            try:
+                sink.put_nowait(value)
+                return
+            except queue.Full:
+                try:
+                    sink.get_nowait()
+                    self.sink_drops[name] += 1
+                except queue.Empty:
+                    pass
+
+    async def run(self):
+        self.queues = {stage: asyncio.Queue(STAGE_QUEUE_SIZE) for stage in self.stages[1:]}
+        await asyncio.gather(
+            self._read(self.queues["frame"]),
+            self._frame(self.queues["frame"], self.queues["parse"]),
+            self._parse(self.queues["parse"], self.queues["apply"]),
+            self._apply(self.queues["apply"], self.queues["fanout"]),
+            self._fanout(self.queues["fanout"]))
@@ -0,0 +1,89 @@
+"""Site -> building -> floor -> zone hierarchy with live pass/fail/missing counts.
+
+Every level keeps the counts of the nodes below it. A result only updates the
+levels on the path of its node, and an overview only reads the children of one
+level, so neither depends on the number of nodes of the site.
+"""
+import threading
+
+LEVELS = ["site", "building", "floor", "zone"]
+STATES = ["passed", "failed", "missing"]
+UNPLACED = "unplaced"
+
+_lock = threading.Lock()
+# Counts per level path, a path being a tuple of up to len(LEVELS) names
+_counts = {}
+# Child names per level path
+_children = {}
+# Nodes of every zone
+_members = {}
+# Path and state of every node
+_nodes = {}
+
+
+def parse_location(text):
+    """Location of a node as written in the nodes file: site/building/floor/zone."""
+    path = tuple(text.split("/")[:len(LEVELS)]) if text else ()
+    return path + (UNPLACED,) * (len(LEVELS) - len(path))
+
+
+def _add(path, state, delta):
+    for depth in range(len(path) + 1):
+        counts = _counts.setdefault(path[:depth], dict.fromkeys(STATES, 0))
+        counts[state] += delta
+
+
+def place(node, location=None):
+    """Add a node to the hierarchy, or move it, it starts out missing."""
+    path = parse_location(location)
+    with _lock:
+        old_path, state = _nodes.get(node, (None, "missing"))
+        if old_path == path:
+            return
+        if old_path is not None:
+            _add(old_path, state, -1)
+            _members[old_path].discard(node)
+        for depth in range(len(path)):
+            _children.setdefault(path[:depth], set()).add(path[depth])
+        _members.setdefault(path, set()).add(node)
+        _nodes[node] = (path, state)
+        _add(path, state, 1)
+
+
+def set_state(node, state):
+    """Record the last result of a node: passed, failed or missing."""
+    with _lock:
+        if node not in _nodes:
+            return
+        path, old = _nodes[node]
+        if old == state:
+            return
+        _add(path, old, -1)
+        _add(path, state, 1)
+        _nodes[node] = (path, state)
+
+
+def reset():
+    """Mark every node missing, when a new test starts."""
+    with _lock:
+        for node, (path, state) in _nodes.items():
+            if state != "missing":
+                _add(path, state, -1)
+                _add(path, "missing", 1)
+                _nodes[node] = (path, "missing")
+
+
+def overview(path=()):
+    """Counts of a level and of each of its children, or the state of each
+    node for a zone."""
+    path = tuple(path)
+    with _lock:
+        result = {
+            "level": LEVELS[len(path) - 1] if path else "all",
+            "counts": dict(_counts.get(path, dict.fromkeys(STATES, 0))),
+            "children": {name: dict(_counts[path + (name,)])
+                         for name in sorted(_children.get(path, ()))},
+        }
+        if len(path) == len(LEVELS):
+            result["nodes"] = {node: _nodes[node][1] for node in sorted(_members.get(path, ()))}
+        return result